@@ -0,0 +1,29 @@
+#ifndef LIBIRC_CASEMAP_H
+#define LIBIRC_CASEMAP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* How a server folds case in nicks and channel names, as announced by
+ * CASEMAPPING in RPL_ISUPPORT. RFC 1459 is what servers default to.
+ */
+typedef enum {
+    irc_casemap_rfc1459 = 0,
+    irc_casemap_strict_rfc1459,
+    irc_casemap_ascii,
+} irc_casemap_t;
+
+irc_casemap_t irc_casemap_parse(char const *name, size_t len);
+
+char irc_casemap_fold(irc_casemap_t cm, char c);
+void irc_casemap_foldn(irc_casemap_t cm, char *dst, char const *src,
+                       size_t len);
+
+bool irc_casemap_equal(irc_casemap_t cm, char const *a, size_t alen,
+                       char const *b, size_t blen);
+int irc_casemap_cmp(irc_casemap_t cm, char const *a, size_t alen,
+                    char const *b, size_t blen);
+uint64_t irc_casemap_hash(irc_casemap_t cm, char const *s, size_t len);
+
+#endif
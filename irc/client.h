@@ -5,6 +5,7 @@
 #include <irc/error.h>
 #include <irc/config.h>
 #include <stdbool.h>
+#include <sys/uio.h>
 
 struct irc_client_;
 typedef struct irc_client_ *irc_client_t;
@@ -27,5 +28,6 @@ irc_error_t irc_client_connect2(irc_client_t c,
 
 int irc_client_read(irc_client_t c, void *buffer, size_t len);
 int irc_client_write(irc_client_t c, void const *buffer, size_t len);
+int irc_client_writev(irc_client_t c, struct iovec const *iov, int iovcnt);
 
 #endif
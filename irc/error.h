@@ -13,6 +13,8 @@ typedef enum {
     irc_error_tls,
     irc_error_io,
     irc_error_parse,
+    /* flood control holds the line back for now */
+    irc_error_again,
 } irc_error_t;
 
 #define IRC_SUCCESS(v) ((v) == irc_error_success)
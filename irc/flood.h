@@ -0,0 +1,31 @@
+#ifndef LIBIRC_FLOOD_H
+#define LIBIRC_FLOOD_H
+
+#include <irc/error.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+
+struct irc_flood_;
+typedef struct irc_flood_ *irc_flood_t;
+
+/* A token bucket kept the way most ircds keep their penalty clock: every
+ * line costs interval milliseconds, plus one more interval for every bytes
+ * bytes of it (0 to ignore the length), and up to burst intervals worth may
+ * be spent ahead of time. Times are milliseconds on any monotonic clock,
+ * irc_flood_now() gives one.
+ *
+ * Not thread safe, it belongs to whoever sends.
+ */
+irc_flood_t irc_flood_new(unsigned burst, unsigned interval, unsigned bytes);
+void irc_flood_free(irc_flood_t f);
+
+void irc_flood_reset(irc_flood_t f);
+
+uint64_t irc_flood_cost(irc_flood_t f, size_t len);
+uint64_t irc_flood_delay(irc_flood_t f, size_t len, uint64_t now);
+irc_error_t irc_flood_take(irc_flood_t f, size_t len, uint64_t now);
+
+uint64_t irc_flood_now(void);
+
+#endif
@@ -13,10 +13,48 @@ typedef struct irc_ * irc_t;
 
 typedef void (*irc_command_handler_t)(irc_t, irc_message_t m, void *);
 
+/* Outgoing messages are sorted into lanes. Control traffic (PONG, QUIT,
+ * CAP, ...) always leaves first, so keep-alives never wait behind a long
+ * backlog. How interactive and bulk share the rest is set with
+ * ircopt_lane_weight.
+ */
+typedef enum {
+    irc_lane_control = 0,
+    irc_lane_interactive,
+    irc_lane_bulk,
+    irc_lane_max,
+} irc_lane_t;
+
 typedef enum {
     ircopt_nick,
     ircopt_realname,
     ircopt_server,
+    /* bool, only decode message tags when a handler asks for them
+     */
+    ircopt_lazytags,
+    /* unsigned, keep up to this many blocks per size class around for
+     * messages, 0 to turn pooling off. getopt returns the irc_pool_t.
+     */
+    ircopt_pool,
+    /* irc_casemap_t, taken from CASEMAPPING once the server announces it
+     */
+    ircopt_casemap,
+    /* irc_lane_t, unsigned. Lanes with a weight get that many messages
+     * per round, lanes with weight 0 only send once all weighted lanes
+     * are empty. The default of 1 for interactive and 0 for bulk is strict
+     * priority. Does not apply to irc_lane_control.
+     */
+    ircopt_lane_weight,
+    /* unsigned burst, unsigned interval, unsigned bytes. Flood control
+     * as described in irc/flood.h, irc_pop() returns irc_error_again while
+     * it holds a line back. A burst of 0 turns it off, which is the
+     * default. getopt returns the irc_flood_t.
+     */
+    ircopt_flood,
+    /* bool, merge JOIN, PART and MODE +o/+v lines waiting next to each
+     * other in the send queue, within TARGMAX and MODES. On by default.
+     */
+    ircopt_coalesce,
 } ircopt_t;
 
 irc_t irc_new(void);
@@ -30,6 +68,10 @@ irc_error_t irc_connected(irc_t i);
 
 irc_error_t irc_queue(irc_t i, irc_message_t m);
 irc_error_t irc_queue_command(irc_t i, char const *type, ...);
+irc_error_t irc_queue_lane(irc_t i, irc_lane_t lane, irc_message_t m);
+irc_error_t irc_queue_command_lane(irc_t i, irc_lane_t lane,
+                                   char const *type, ...);
+irc_lane_t irc_lane_default(irc_message_t m);
 
 irc_error_t irc_setopt(irc_t i, ircopt_t o, ...);
 irc_error_t irc_getopt(irc_t i, ircopt_t o, ...);
@@ -39,6 +81,13 @@ irc_error_t irc_handler_add(irc_t i, char const *cmd,
                             void *arg);
 
 irc_error_t irc_pop(irc_t i, char **message, size_t *len);
+irc_error_t irc_pop_wait(irc_t i, char **message, size_t *len, int timeout);
+int irc_queue_fd(irc_t i);
+/* milliseconds until irc_pop() has a line to give, -1 if nothing is
+ * queued. Suitable as a poll() timeout together with irc_queue_fd(), which
+ * stays quiet while flood control holds a line back.
+ */
+int irc_pop_timeout(irc_t i);
 
 irc_error_t irc_join(irc_t i, char const *channel);
 
@@ -3,11 +3,16 @@
 
 #include <irc/error.h>
 #include <irc/tag.h>
+#include <irc/pool.h>
+#include <irc/casemap.h>
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+#include <sys/uio.h>
 
 #define IRC_PROTOCOL_DELIMITER "\r\n"
 
@@ -17,30 +22,164 @@
 
 #define IRC_ERR_NICKNAMEINUSE      "433"
 
+/* RFC 2812 allows at most 15 arguments, the 15th always being the final one
+ */
+#define IRC_MESSAGE_MAXARGS        15
+
+typedef enum {
+    /* prefix, command, args and tags all live in the same allocation as
+     * the message, and must not be freed or replaced individually.
+     */
+    irc_message_flag_packed = (1 << 0),
+    /* tags are only kept raw, and decoded on first access through
+     * irc_message_tag_get() or irc_message_tags_decode().
+     */
+    irc_message_flag_lazytags = (1 << 1),
+    /* the message, and lazily decoded tags, were taken from an irc_pool_t
+     * and are handed back to it once the last reference is gone.
+     */
+    irc_message_flag_pooled = (1 << 2),
+} irc_message_flag_t;
+
+typedef enum {
+    irc_command_unknown = 0,
+    /* 1 to 999 are three digit numeric replies, by their value
+     */
+    irc_command_privmsg = 1000,
+    irc_command_notice,
+    irc_command_join,
+    irc_command_part,
+    irc_command_quit,
+    irc_command_nick,
+    irc_command_mode,
+    irc_command_ping,
+    irc_command_pong,
+    irc_command_kick,
+    irc_command_invite,
+    irc_command_topic,
+    irc_command_cap,
+    irc_command_authenticate,
+    irc_command_error,
+    irc_command_user,
+    irc_command_pass,
+    irc_command_kill,
+    irc_command_away,
+    irc_command_account,
+    irc_command_chghost,
+    irc_command_batch,
+    irc_command_tagmsg,
+    irc_command_setname,
+    irc_command_wallops,
+    irc_command_names,
+    irc_command_who,
+    irc_command_whois,
+    irc_command_list,
+    irc_command_squit,
+} irc_command_t;
+
+typedef struct {
+    char const *ptr;
+    size_t len;
+} irc_slice_t;
+
+/* A parsed message that borrows everything from the line it was parsed
+ * from, as slices that are not NUL terminated. Pieces that are not present
+ * have a NULL pointer. The tags slice holds the raw, still escaped, tags.
+ */
+typedef struct {
+    irc_slice_t tags;
+    irc_slice_t prefix;
+    irc_slice_t command;
+    irc_command_t code;
+    irc_slice_t args[IRC_MESSAGE_MAXARGS];
+    size_t argslen;
+} irc_message_view_t;
+
+/* nick!user@host, split once when the message is built. A prefix without
+ * '!' and '@' is taken to be all nick, as with server names. Only packed
+ * messages use it as a cache, other messages may have their prefix
+ * replaced, so theirs is split on every access.
+ */
+typedef struct {
+    char const *of;
+    irc_slice_t nick;
+    irc_slice_t user;
+    irc_slice_t host;
+} irc_prefix_t;
+
+/* where the well known tags are found in the tags of a message, as index
+ * plus one. Only valid for the tag vector it was built for, and only
+ * relied upon for packed messages.
+ */
+typedef struct {
+    irc_tag_t *of;
+    size_t len;
+    unsigned short slot[irc_tag_key_max];
+} irc_tag_index_t;
+
 struct irc_message_
 {
-    int ref;
+    /* the fields up to tagslen keep the layout of earlier releases, new
+     * ones only ever go after them
+     */
+    atomic_int ref;
     char *prefix;
     char *command;
     char **args;
     size_t argslen;
     irc_tag_t *tags;
     size_t tagslen;
+    unsigned int flags;
+    irc_command_t code;
+    irc_slice_t rawtags;
+    /* set once lazy tags have been decoded, tags and tagslen may only be
+     * relied upon after that
+     */
+    atomic_bool tagsready;
+    irc_tag_index_t tagindex;
+    irc_prefix_t source;
+    /* shared by all messages of one irc_message_parse_batch()
+     */
+    struct irc_message_arena_ *arena;
 };
 
 typedef struct irc_message_ *irc_message_t;
 
+irc_command_t irc_command_code(char const *cmd, size_t len);
+
 irc_message_t irc_message_new(void);
 
 void irc_message_unref(irc_message_t m);
 void irc_message_ref(irc_message_t m);
 
 irc_message_t irc_message_parse2(char const *line, size_t linesize);
+irc_message_t irc_message_parse_packed(char const *line, size_t linesize);
 
 irc_error_t irc_message_parse(irc_message_t m,
                               char const *line,
                               size_t lensize);
 
+irc_error_t irc_message_view_parse(irc_message_view_t *v,
+                                   char const *line,
+                                   size_t linesize);
+irc_message_t irc_message_view_promote(irc_message_view_t const *v,
+                                       unsigned int flags);
+irc_error_t irc_message_parse_batch(struct iovec const *lines, size_t n,
+                                    irc_message_t *msgs, unsigned int flags);
+void irc_message_unref_batch(irc_message_t *msgs, size_t n);
+irc_message_t irc_message_view_promote_pool(irc_message_view_t const *v,
+                                            unsigned int flags,
+                                            irc_pool_t pool);
+
+bool irc_message_view_tag(irc_message_view_t const *v, char const **pos,
+                          irc_slice_t *key, irc_slice_t *value);
+bool irc_message_view_is(irc_message_view_t const *v, char const *cmd);
+bool irc_message_view_arg_is(irc_message_view_t const *v, size_t idx,
+                             char const *what);
+
+/* The result is packed, its prefix, command and args must not be freed or
+ * replaced individually.
+ */
 irc_message_t irc_message_privmsg(char const *prefix,
                                   char const *target,
                                   char const *msg, ...);
@@ -51,11 +190,38 @@ irc_message_t irc_message_make(char const *prefix,
 irc_message_t irc_message_makev(char const *prefix,
                                 char const *command,
                                 va_list lst);
+/* Takes the message from pool, if there is one. Unless there are more than
+ * IRC_MESSAGE_MAXARGS arguments the result is packed, and its prefix,
+ * command and args must not be freed or replaced individually.
+ */
+irc_message_t irc_message_makev_pool(irc_pool_t pool,
+                                     char const *prefix,
+                                     char const *command,
+                                     va_list lst);
 
 irc_error_t irc_message_string(irc_message_t m, char **s, size_t *slen);
+/* Writes the wire form of m, CR LF included, to buf without a terminating
+ * NUL. Returns its length, which is also the size required when cap is too
+ * small, in which case nothing is written. Passing NULL and 0 just measures.
+ */
+ssize_t irc_message_serialize_into(irc_message_t m, char *buf, size_t cap);
+irc_error_t irc_message_serialize_iov(irc_message_t m, struct iovec *iov,
+                                      int *n);
+
+irc_error_t irc_message_tags_decode(irc_message_t m);
+irc_tag_t irc_message_tag_get(irc_message_t m, char const *key);
+irc_tag_t irc_message_tag_known(irc_message_t m, irc_tag_key_t key);
 
 bool irc_message_is(irc_message_t m, char const *cmd);
+bool irc_message_is_code(irc_message_t m, irc_command_t code);
 bool irc_message_arg_is(irc_message_t m, size_t idx, char const *what);
 bool irc_message_prefix_nick(irc_message_t m, char const *nick);
+bool irc_message_prefix_nick_casemap(irc_message_t m, char const *nick,
+                                     irc_casemap_t cm);
+bool irc_message_arg_is_casemap(irc_message_t m, size_t idx,
+                                char const *what, irc_casemap_t cm);
+irc_slice_t irc_message_prefix_nick_view(irc_message_t m);
+irc_slice_t irc_message_prefix_user_view(irc_message_t m);
+irc_slice_t irc_message_prefix_host_view(irc_message_t m);
 
 #endif
@@ -0,0 +1,36 @@
+#ifndef LIBIRC_POOL_H
+#define LIBIRC_POOL_H
+
+#include <irc/error.h>
+
+#include <stdlib.h>
+
+struct irc_pool_;
+typedef struct irc_pool_ *irc_pool_t;
+
+typedef struct {
+    /* allocations served from a free list */
+    size_t hits;
+    /* allocations that had to go to malloc() */
+    size_t misses;
+    /* blocks handed back and kept for reuse */
+    size_t recycled;
+    /* blocks handed back and freed, because their free list was full */
+    size_t dropped;
+    /* blocks currently kept on the free lists */
+    size_t cached;
+    /* blocks currently handed out */
+    size_t used;
+} irc_pool_stats_t;
+
+irc_pool_t irc_pool_new(size_t cap);
+void irc_pool_free(irc_pool_t p);
+
+void irc_pool_set_cap(irc_pool_t p, size_t cap);
+irc_error_t irc_pool_stats(irc_pool_t p, irc_pool_stats_t *stats);
+
+void *irc_pool_alloc(irc_pool_t p, size_t size);
+void irc_pool_release(void *ptr);
+irc_pool_t irc_pool_owner(void *ptr);
+
+#endif
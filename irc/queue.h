@@ -3,6 +3,8 @@
 
 #include <irc/error.h>
 
+#include <stddef.h>
+
 typedef void (*free_t)(void*);
 
 struct irc_queue;
@@ -15,5 +17,7 @@ void irc_queue_free(irc_queue_t q);
 void irc_queue_clear(irc_queue_t q, free_t f);
 irc_error_t irc_queue_push(irc_queue_t q, void *what);
 void *irc_queue_pop(irc_queue_t q);
+size_t irc_queue_pop_n(irc_queue_t q, void **out, size_t n);
+size_t irc_queue_len(irc_queue_t q);
 
 #endif
@@ -3,6 +3,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <sys/uio.h>
 
 struct strbuf_;
 
@@ -16,8 +17,16 @@ ssize_t strbuf_getdelim(strbuf_t b, char **line, size_t *linesize, int delim);
 ssize_t strbuf_getline(strbuf_t b, char **line, size_t *linesize);
 ssize_t strbuf_getstr(strbuf_t b, char **line, size_t *linesize,
                       char const *small);
+ssize_t strbuf_peekstr(strbuf_t b, char const **line, size_t *linesize,
+                       char const *small);
+ssize_t strbuf_peekstrv(strbuf_t b, struct iovec *iov, size_t iovcnt,
+                        char const *small);
 char *strbuf_strdup(strbuf_t b);
 
+int strbuf_reserve(strbuf_t b, size_t len);
+int strbuf_shrink(strbuf_t b);
+void strbuf_set_highwater(strbuf_t b, size_t size);
+
 int strbuf_getc(strbuf_t b);
 int strbuf_delete(strbuf_t b, size_t how);
 
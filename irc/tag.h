@@ -12,6 +12,20 @@ struct irc_tag_
 };
 typedef struct irc_tag_ *irc_tag_t;
 
+/* tag keys that get a slot of their own on messages
+ */
+typedef enum {
+    irc_tag_key_unknown = 0,
+    irc_tag_key_time,
+    irc_tag_key_msgid,
+    irc_tag_key_account,
+    irc_tag_key_batch,
+    irc_tag_key_label,
+    irc_tag_key_max,
+} irc_tag_key_t;
+
+irc_tag_key_t irc_tag_key(char const *key, size_t len);
+
 irc_tag_t irc_tag_new(void);
 void irc_tag_free(irc_tag_t t);
 
@@ -22,6 +36,8 @@ irc_tag_t irc_tag_make(char const *key, char const *value);
 irc_error_t irc_tag_string(irc_tag_t t, char **s, size_t *slen);
 
 char *irc_tag_unescape(char const *value);
+size_t irc_tag_unescape_into(char *dst, char const *value, size_t len);
 char *irc_tag_escape(char const *value);
+size_t irc_tag_escape_into(char *dst, char const *value);
 
 #endif
@@ -0,0 +1,29 @@
+#ifndef LIBIRC_TEMPLATE_H
+#define LIBIRC_TEMPLATE_H
+
+#include <irc/error.h>
+#include <irc/message.h>
+#include <irc/pool.h>
+
+#include <sys/types.h>
+
+#define IRC_TEMPLATE_MAXSLOTS      IRC_MESSAGE_MAXARGS
+
+struct irc_template_;
+typedef struct irc_template_ *irc_template_t;
+
+/* A shape is a protocol line with %s where arguments go, for example
+ * "PRIVMSG %s :%s". A %s after " :" is the final argument and may hold
+ * spaces, any other must be a single word.
+ */
+irc_template_t irc_template_new(char const *shape);
+void irc_template_free(irc_template_t t);
+
+size_t irc_template_slots(irc_template_t t);
+
+ssize_t irc_template_render(irc_template_t t, char *buf, size_t cap,
+                            irc_slice_t const *args, size_t argslen);
+irc_message_t irc_template_message(irc_template_t t, irc_pool_t pool,
+                                   irc_slice_t const *args, size_t argslen);
+
+#endif
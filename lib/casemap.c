@@ -0,0 +1,156 @@
+#include <irc/casemap.h>
+
+#include <string.h>
+
+/* All three mappings fold a single range onto the one 32 above it:
+ *
+ *   ascii           A-Z       to a-z
+ *   strict-rfc1459  A-Z[\]    to a-z{|}
+ *   rfc1459         A-Z[\]^   to a-z{|}~
+ *
+ * Those bytes all lack 0x20, so folding sets it. That lets us fold eight
+ * bytes at once in a plain 64 bit word.
+ */
+static unsigned char const irc_casemap_upper[] = {
+    [irc_casemap_rfc1459] = '^',
+    [irc_casemap_strict_rfc1459] = ']',
+    [irc_casemap_ascii] = 'Z',
+};
+
+#define IRC_CASEMAP_ONES   0x0101010101010101ULL
+#define IRC_CASEMAP_HIGH   0x8080808080808080ULL
+
+static uint64_t irc_casemap_word(irc_casemap_t cm, uint64_t w)
+{
+    uint64_t low = w & ~IRC_CASEMAP_HIGH;
+    /* high bit set for bytes from 'A', and for bytes past the upper end
+     */
+    uint64_t ge = low + (0x80 - 'A') * IRC_CASEMAP_ONES;
+    uint64_t gt = low + (0x7f - irc_casemap_upper[cm]) * IRC_CASEMAP_ONES;
+    uint64_t mask = ge & ~gt & ~w & IRC_CASEMAP_HIGH;
+
+    return w | (mask >> 2);
+}
+
+static uint64_t irc_casemap_load(char const *s, size_t len)
+{
+    uint64_t w = 0;
+
+    memcpy(&w, s, (len < 8 ? len : 8));
+    return w;
+}
+
+irc_casemap_t irc_casemap_parse(char const *name, size_t len)
+{
+    if (name != NULL) {
+        if (len == 5 && strncmp(name, "ascii", 5) == 0) {
+            return irc_casemap_ascii;
+        }
+        if (len == 14 && strncmp(name, "strict-rfc1459", 14) == 0) {
+            return irc_casemap_strict_rfc1459;
+        }
+    }
+
+    return irc_casemap_rfc1459;
+}
+
+char irc_casemap_fold(irc_casemap_t cm, char c)
+{
+    unsigned char u = (unsigned char)c;
+
+    if (u >= 'A' && u <= irc_casemap_upper[cm]) {
+        return (char)(u | 0x20);
+    }
+
+    return c;
+}
+
+void irc_casemap_foldn(irc_casemap_t cm, char *dst, char const *src,
+                       size_t len)
+{
+    size_t i = 0;
+
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w = irc_casemap_word(cm, irc_casemap_load(src + i, 8));
+        memcpy(dst + i, &w, 8);
+    }
+
+    for (; i < len; i++) {
+        dst[i] = irc_casemap_fold(cm, src[i]);
+    }
+}
+
+bool irc_casemap_equal(irc_casemap_t cm, char const *a, size_t alen,
+                       char const *b, size_t blen)
+{
+    if (alen != blen) {
+        return false;
+    }
+
+    for (size_t i = 0; i < alen; i += 8) {
+        size_t n = alen - i;
+        uint64_t wa = irc_casemap_load(a + i, n);
+        uint64_t wb = irc_casemap_load(b + i, n);
+
+        if (wa != wb &&
+            irc_casemap_word(cm, wa) != irc_casemap_word(cm, wb)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int irc_casemap_cmp(irc_casemap_t cm, char const *a, size_t alen,
+                    char const *b, size_t blen)
+{
+    size_t len = (alen < blen ? alen : blen);
+    size_t i = 0;
+
+    /* skip whole words that fold the same, and settle the rest bytewise
+     */
+    for (; i + 8 <= len; i += 8) {
+        uint64_t wa = irc_casemap_word(cm, irc_casemap_load(a + i, 8));
+        uint64_t wb = irc_casemap_word(cm, irc_casemap_load(b + i, 8));
+
+        if (wa != wb) {
+            break;
+        }
+    }
+
+    for (; i < len; i++) {
+        unsigned char ca = irc_casemap_fold(cm, a[i]);
+        unsigned char cb = irc_casemap_fold(cm, b[i]);
+
+        if (ca != cb) {
+            return (ca < cb ? -1 : 1);
+        }
+    }
+
+    if (alen == blen) {
+        return 0;
+    }
+
+    return (alen < blen ? -1 : 1);
+}
+
+uint64_t irc_casemap_hash(irc_casemap_t cm, char const *s, size_t len)
+{
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ len;
+
+    /* a word at a time, folded, then mixed in by multiplication
+     */
+    for (size_t i = 0; i < len; i += 8) {
+        uint64_t w = irc_casemap_word(cm, irc_casemap_load(s + i, len - i));
+
+        h ^= w;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 32;
+    }
+
+    h ^= h >> 29;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 32;
+
+    return h;
+}
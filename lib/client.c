@@ -265,3 +265,20 @@ int irc_client_write(irc_client_t c, void const *buffer, size_t len)
         return write(c->fd, buffer, len);
     }
 }
+
+int irc_client_writev(irc_client_t c, struct iovec const *iov, int iovcnt)
+{
+    if (c->fd == -1) {
+        return -1;
+    }
+
+    if (c->ssl && c->tls == NULL) {
+        return -1;
+    }
+
+    if (c->ssl) {
+        return irc_ssl_client_writev(c->tls, iov, iovcnt);
+    } else {
+        return writev(c->fd, iov, iovcnt);
+    }
+}
@@ -6,6 +6,7 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdatomic.h>
 
 extern int yylex_init_extra(void *extra, void **state);
 extern int yylex_destroy(void *state);
@@ -18,7 +19,7 @@ extern int yyparse(void *scanner, irc_config_t config);
 
 struct irc_config_network_
 {
-    int ref;
+    atomic_int ref;
     char *name;
     char *host;
     char *port;
@@ -150,7 +151,7 @@ irc_config_network_t irc_config_network_new(char const *name)
     n->name = strdup(name);
     n->ssl = true;
     n->nickserv = strdup("nickserv");
-    n->ref = 1;
+    atomic_init(&n->ref, 1);
 
     return n;
 }
@@ -233,7 +234,7 @@ void irc_config_network_ref(irc_config_network_t n)
         return;
     }
 
-    ++n->ref;
+    atomic_fetch_add_explicit(&n->ref, 1, memory_order_relaxed);
 }
 
 void irc_config_network_unref(irc_config_network_t n)
@@ -242,9 +243,7 @@ void irc_config_network_unref(irc_config_network_t n)
         return;
     }
 
-    --n->ref;
-
-    if (n->ref > 0) {
+    if (atomic_fetch_sub_explicit(&n->ref, 1, memory_order_acq_rel) > 1) {
         return;
     }
 
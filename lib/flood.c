@@ -0,0 +1,102 @@
+#include <irc/flood.h>
+
+#include <time.h>
+
+/* Rather than counting tokens this keeps the time at which all cost spent
+ * so far has drained. A line may go out as long as that stays within the
+ * burst window from now, which is the same bucket seen from the other
+ * side and needs no refill step.
+ */
+struct irc_flood_
+{
+    uint64_t window;
+    uint64_t interval;
+    uint64_t bytes;
+
+    uint64_t clock;
+};
+
+irc_flood_t irc_flood_new(unsigned burst, unsigned interval, unsigned bytes)
+{
+    irc_flood_t f = NULL;
+
+    return_if_true(burst == 0 || interval == 0, NULL);
+
+    f = calloc(1, sizeof(struct irc_flood_));
+    if (f == NULL) {
+        return NULL;
+    }
+
+    f->window = (uint64_t)burst * interval;
+    f->interval = interval;
+    f->bytes = bytes;
+
+    return f;
+}
+
+void irc_flood_free(irc_flood_t f)
+{
+    free(f);
+}
+
+void irc_flood_reset(irc_flood_t f)
+{
+    return_if_true(f == NULL,);
+    f->clock = 0;
+}
+
+uint64_t irc_flood_cost(irc_flood_t f, size_t len)
+{
+    return_if_true(f == NULL, 0);
+
+    if (f->bytes == 0) {
+        return f->interval;
+    }
+
+    return f->interval + f->interval * len / f->bytes;
+}
+
+uint64_t irc_flood_delay(irc_flood_t f, size_t len, uint64_t now)
+{
+    uint64_t clock = 0, cost = 0;
+
+    return_if_true(f == NULL, 0);
+
+    clock = (f->clock > now ? f->clock : now);
+    cost = irc_flood_cost(f, len);
+
+    /* a line costlier than the whole window waits until nothing is owed,
+     * otherwise it could never be sent at all
+     */
+    if (cost > f->window) {
+        return clock - now;
+    }
+
+    if (clock + cost <= now + f->window) {
+        return 0;
+    }
+
+    return clock + cost - (now + f->window);
+}
+
+irc_error_t irc_flood_take(irc_flood_t f, size_t len, uint64_t now)
+{
+    return_if_true(f == NULL, irc_error_argument);
+    return_if_true(irc_flood_delay(f, len, now) > 0, irc_error_again);
+
+    if (f->clock < now) {
+        f->clock = now;
+    }
+    f->clock += irc_flood_cost(f, len);
+
+    return irc_error_success;
+}
+
+uint64_t irc_flood_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
@@ -122,3 +122,31 @@ int irc_ssl_client_write(void *arg, void const *buffer, size_t size)
 
     return ret;
 }
+
+int irc_ssl_client_writev(void *arg, struct iovec const *iov, int iovcnt)
+{
+    gnutls_t *p = (gnutls_t*)arg;
+    ssize_t ret = 0;
+
+    /* corked data is collected into as few records as possible, and only
+     * sent once we uncork
+     */
+    gnutls_record_cork(p->session);
+    for (int i = 0; i < iovcnt; i++) {
+        do {
+            ret = gnutls_record_send(p->session, iov[i].iov_base,
+                                     iov[i].iov_len);
+        } while (ret == GNUTLS_E_INTERRUPTED || ret == GNUTLS_E_AGAIN);
+
+        if (ret < 0) {
+            gnutls_record_uncork(p->session, 0);
+            return ret;
+        }
+    }
+
+    do {
+        ret = gnutls_record_uncork(p->session, GNUTLS_RECORD_WAIT);
+    } while (ret == GNUTLS_E_INTERRUPTED || ret == GNUTLS_E_AGAIN);
+
+    return ret;
+}
@@ -3,15 +3,39 @@
 #include <irc/util.h>
 #include <irc/message.h>
 #include <irc/queue.h>
+#include <irc/pool.h>
+#include <irc/flood.h>
+#include "sendq.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <pthread.h>
 #include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+#include <limits.h>
+
+/* maximum number of lines handled per irc_think() call
+ */
+#define IRC_THINK_BATCH 64
+
+/* messages the send queue takes before it falls back to locking
+ */
+#define IRC_SENDQ_SIZE 1024
+
+/* longest line a server accepts, CR LF included
+ */
+#define IRC_LINE_MAX 512
+
+/* MODES when the server does not say, as in RFC 2812
+ */
+#define IRC_DEFAULT_MODES 3
 
 typedef struct {
     char cmd[100];
+    irc_command_t code;
     irc_command_handler_t handler;
     void *arg;
 } irc_handler_t;
@@ -40,17 +64,46 @@ struct irc_
 
     irc_state_t state;
 
-    pthread_mutex_t sendqmtx;
-    irc_queue_t sendq;
+    bool lazytags;
+    irc_pool_t pool;
+    irc_casemap_t casemap;
+
+    /* held by whoever takes from the send queue, irc_pop() and friends,
+     * so irc_reset() and irc_setopt() can be called from any thread
+     */
+    pthread_mutex_t popmtx;
+    irc_sendq_t sendq;
+    unsigned weight[irc_lane_max];
+    unsigned credit[irc_lane_max];
+
+    /* popped, but held back by flood control, and a line a control
+     * message overtook while it waited
+     */
+    irc_flood_t flood;
+    irc_message_t held;
+    size_t heldlane;
+    irc_message_t deferred;
+    size_t deferredlane;
+
+    /* limits for merging queued JOIN, PART and MODE lines, 0 for none
+     */
+    bool coalesce;
+    unsigned targmax_join;
+    unsigned targmax_part;
+    unsigned maxmodes;
 
     irc_queue_t channels;
 };
 
 static void irc_ping_handler(irc_t i, irc_message_t m, void *unused)
 {
-    /* queue pong
+    /* queue pong, echoing the token back if the server sent one
      */
-    irc_queue_command(i, "PONG", NULL);
+    if (m->argslen > 0) {
+        irc_queue_command(i, "PONG", m->args[0], NULL);
+    } else {
+        irc_queue_command(i, "PONG", NULL);
+    }
 }
 
 static void irc_invite_handler(irc_t i, irc_message_t m, void *unused)
@@ -65,6 +118,70 @@ static void irc_invite_handler(irc_t i, irc_message_t m, void *unused)
     irc_join(i, channel);
 }
 
+static bool irc_isupport_key(char const **arg, char const *key)
+{
+    size_t len = strlen(key);
+
+    if (strncmp(*arg, key, len) != 0 ||
+        ((*arg)[len] != '\0' && (*arg)[len] != '=')) {
+        return false;
+    }
+
+    *arg += len;
+    if (**arg == '=') {
+        ++*arg;
+    }
+
+    return true;
+}
+
+/* TARGMAX=PRIVMSG:4,JOIN:,PART:10, an empty limit means none
+ */
+static void irc_isupport_targmax(irc_t i, char const *arg)
+{
+    while (*arg != '\0') {
+        size_t len = strcspn(arg, ":,");
+        unsigned limit = 0;
+        char const *cmd = arg;
+
+        arg += len;
+        if (*arg == ':') {
+            limit = (unsigned)strtoul(arg + 1, NULL, 10);
+            arg += strcspn(arg, ",");
+        }
+
+        if (len == 4 && strncasecmp(cmd, "JOIN", 4) == 0) {
+            i->targmax_join = limit;
+        } else if (len == 4 && strncasecmp(cmd, "PART", 4) == 0) {
+            i->targmax_part = limit;
+        }
+
+        if (*arg == ',') {
+            ++arg;
+        }
+    }
+}
+
+static void irc_isupport_handler(irc_t i, irc_message_t m, void *unused)
+{
+    /* the first argument is our own nick, the last one human text. The
+     * limits are read while popping, so they change under its lock.
+     */
+    pthread_mutex_lock(&i->popmtx);
+    for (size_t idx = 1; idx + 1 < m->argslen; idx++) {
+        char const *arg = m->args[idx];
+
+        if (irc_isupport_key(&arg, "CASEMAPPING")) {
+            i->casemap = irc_casemap_parse(arg, strlen(arg));
+        } else if (irc_isupport_key(&arg, "TARGMAX")) {
+            irc_isupport_targmax(i, arg);
+        } else if (irc_isupport_key(&arg, "MODES")) {
+            i->maxmodes = (unsigned)strtoul(arg, NULL, 10);
+        }
+    }
+    pthread_mutex_unlock(&i->popmtx);
+}
+
 irc_t irc_new(void)
 {
     irc_t i = NULL;
@@ -81,11 +198,16 @@ irc_t irc_new(void)
         return NULL;
     }
 
-    i->sendq = irc_queue_new();
+    pthread_mutex_init(&i->popmtx, NULL);
+
+    i->sendq = irc_sendq_new(IRC_SENDQ_SIZE, irc_lane_max);
     if (i->sendq == NULL) {
         irc_free(i);
         return NULL;
     }
+    i->weight[irc_lane_interactive] = 1;
+    i->coalesce = true;
+    i->maxmodes = IRC_DEFAULT_MODES;
 
     i->channels = irc_queue_new();
     if (i->channels == NULL) {
@@ -101,10 +223,10 @@ irc_t irc_new(void)
     }
 
     pthread_mutex_init(&i->buffermtx, NULL);
-    pthread_mutex_init(&i->sendqmtx, NULL);
 
     irc_handler_add(i, "PING", irc_ping_handler, NULL);
     irc_handler_add(i, "INVITE", irc_invite_handler, NULL);
+    irc_handler_add(i, "005", irc_isupport_handler, NULL);
 
     return i;
 }
@@ -122,20 +244,39 @@ void irc_free(irc_t i)
     free(i->realname);
     free(i->server);
 
+    irc_queue_clear(i->channels, (free_t)free);
     irc_queue_free(i->channels);
 
-    pthread_mutex_lock(&i->sendqmtx);
-    pthread_mutex_destroy(&i->sendqmtx);
-    irc_queue_free(i->sendq);
+    irc_sendq_free(i->sendq, (free_t)irc_message_unref);
+    pthread_mutex_destroy(&i->popmtx);
+    irc_message_unref(i->held);
+    irc_message_unref(i->deferred);
+    irc_flood_free(i->flood);
+
+    /* messages still referenced elsewhere keep the pool alive
+     */
+    irc_pool_free(i->pool);
 
     free(i);
 }
 
 irc_error_t irc_reset(irc_t i)
 {
-    pthread_mutex_lock(&i->sendqmtx);
-    irc_queue_clear(i->sendq, (free_t)irc_message_unref);
-    pthread_mutex_unlock(&i->sendqmtx);
+    pthread_mutex_lock(&i->popmtx);
+    for (size_t l = 0; l < irc_lane_max; l++) {
+        irc_sendq_clear(i->sendq, l, (free_t)irc_message_unref);
+        i->credit[l] = 0;
+    }
+    irc_message_unref(i->held);
+    i->held = NULL;
+    irc_message_unref(i->deferred);
+    i->deferred = NULL;
+    irc_flood_reset(i->flood);
+    i->casemap = irc_casemap_rfc1459;
+    i->targmax_join = 0;
+    i->targmax_part = 0;
+    i->maxmodes = IRC_DEFAULT_MODES;
+    pthread_mutex_unlock(&i->popmtx);
 
     irc_queue_clear(i->channels, (free_t)free);
     strbuf_reset(i->buf);
@@ -170,6 +311,48 @@ irc_error_t irc_getopt(irc_t i, ircopt_t o, ...)
         *s = i->realname;
     } break;
 
+    case ircopt_lazytags:
+    {
+        bool *b = va_arg(lst, bool*);
+        *b = i->lazytags;
+    } break;
+
+    case ircopt_coalesce:
+    {
+        bool *b = va_arg(lst, bool*);
+        *b = i->coalesce;
+    } break;
+
+    case ircopt_pool:
+    {
+        irc_pool_t *p = va_arg(lst, irc_pool_t*);
+        *p = i->pool;
+    } break;
+
+    case ircopt_casemap:
+    {
+        irc_casemap_t *cm = va_arg(lst, irc_casemap_t*);
+        *cm = i->casemap;
+    } break;
+
+    case ircopt_lane_weight:
+    {
+        irc_lane_t lane = (irc_lane_t)va_arg(lst, int);
+        unsigned *w = va_arg(lst, unsigned*);
+
+        if (lane <= irc_lane_control || lane >= irc_lane_max) {
+            e = irc_error_argument;
+        } else {
+            *w = i->weight[lane];
+        }
+    } break;
+
+    case ircopt_flood:
+    {
+        irc_flood_t *f = va_arg(lst, irc_flood_t*);
+        *f = i->flood;
+    } break;
+
     default: e = irc_error_argument; break;
 
     }
@@ -203,6 +386,80 @@ irc_error_t irc_setopt(irc_t i, ircopt_t o, ...)
         i->realname = strdup(va_arg(lst, char*));
     } break;
 
+    case ircopt_lazytags:
+    {
+        i->lazytags = (va_arg(lst, int) != 0);
+    } break;
+
+    case ircopt_coalesce:
+    {
+        bool b = (va_arg(lst, int) != 0);
+
+        pthread_mutex_lock(&i->popmtx);
+        i->coalesce = b;
+        pthread_mutex_unlock(&i->popmtx);
+    } break;
+
+    case ircopt_pool:
+    {
+        unsigned cap = va_arg(lst, unsigned);
+
+        if (cap == 0) {
+            irc_pool_free(i->pool);
+            i->pool = NULL;
+        } else if (i->pool != NULL) {
+            irc_pool_set_cap(i->pool, cap);
+        } else {
+            i->pool = irc_pool_new(cap);
+            if (i->pool == NULL) {
+                e = irc_error_memory;
+            }
+        }
+    } break;
+
+    case ircopt_casemap:
+    {
+        i->casemap = (irc_casemap_t)va_arg(lst, int);
+    } break;
+
+    case ircopt_lane_weight:
+    {
+        irc_lane_t lane = (irc_lane_t)va_arg(lst, int);
+        unsigned w = va_arg(lst, unsigned);
+
+        if (lane <= irc_lane_control || lane >= irc_lane_max) {
+            e = irc_error_argument;
+        } else {
+            /* start a fresh round with the new weights
+             */
+            pthread_mutex_lock(&i->popmtx);
+            i->weight[lane] = w;
+            memset(i->credit, 0, sizeof(i->credit));
+            pthread_mutex_unlock(&i->popmtx);
+        }
+    } break;
+
+    case ircopt_flood:
+    {
+        unsigned burst = va_arg(lst, unsigned);
+        unsigned interval = va_arg(lst, unsigned);
+        unsigned bytes = va_arg(lst, unsigned);
+        irc_flood_t f = NULL;
+
+        if (burst > 0) {
+            f = irc_flood_new(burst, interval, bytes);
+            if (f == NULL) {
+                e = irc_error_argument;
+                break;
+            }
+        }
+
+        pthread_mutex_lock(&i->popmtx);
+        irc_flood_free(i->flood);
+        i->flood = f;
+        pthread_mutex_unlock(&i->popmtx);
+    } break;
+
     default: e = irc_error_argument; break;
 
     }
@@ -230,56 +487,66 @@ irc_error_t irc_feed(irc_t i, char const *buffer, size_t len)
 
 static irc_error_t irc_think_data(irc_t i)
 {
-    ssize_t s = 0;
-    char *line = NULL;
-    size_t linesize = 0;
-    irc_error_t r = irc_error_internal;
-    irc_message_t m = NULL;
-
-    pthread_mutex_lock(&i->buffermtx);
-    s = strbuf_getstr(i->buf, &line, &linesize, "\r\n");
-    pthread_mutex_unlock(&i->buffermtx);
-
-    if (s < 0) {
-        r = irc_error_success;
-        goto cleanup;
-    }
-
-    /* strip \r\n from the line
+    struct iovec lines[IRC_THINK_BATCH];
+    irc_message_t msgs[IRC_THINK_BATCH] = {0};
+    irc_error_t r = irc_error_success;
+    size_t consumed = 0;
+    ssize_t n = 0;
+    unsigned int flags = (i->lazytags ? irc_message_flag_lazytags : 0);
+
+    /* take every complete line there is under one lock, parse them straight
+     * out of the receive buffer (without the \r\n), and only then consume
+     * them. Handlers are run after the lock has been dropped.
      */
-    if (linesize > 2) {
-        linesize -= 2;
+    pthread_mutex_lock(&i->buffermtx);
+    n = strbuf_peekstrv(i->buf, lines, IRC_THINK_BATCH,
+                        IRC_PROTOCOL_DELIMITER);
+    for (ssize_t k = 0; k < n; k++) {
+        consumed += lines[k].iov_len;
+        lines[k].iov_len -= 2;
     }
 
-    m = irc_message_new();
-    if (m == NULL) {
-        r = irc_error_memory;
-        goto cleanup;
-    }
+    if (i->pool != NULL) {
+        for (ssize_t k = 0; k < n; k++) {
+            irc_message_view_t v;
 
-    r = irc_message_parse(m, line, linesize);
-    if (IRC_FAILED(r)) {
-        goto cleanup;
+            irc_message_view_parse(&v, lines[k].iov_base, lines[k].iov_len);
+            msgs[k] = irc_message_view_promote_pool(&v, flags, i->pool);
+            if (msgs[k] == NULL) {
+                r = irc_error_memory;
+            }
+        }
+    } else if (n > 0) {
+        /* all of them in one allocation
+         */
+        r = irc_message_parse_batch(lines, n, msgs, flags);
     }
+    strbuf_delete(i->buf, consumed);
+    pthread_mutex_unlock(&i->buffermtx);
 
-    for (size_t idx = 0; idx < i->handlerlen; idx++) {
-        irc_handler_t *h = i->handler + idx;
+    for (ssize_t k = 0; k < n; k++) {
+        irc_message_t m = msgs[k];
 
-        if (strlen(h->cmd) == 0 ||
-            strcmp(h->cmd, m->command) == 0) {
-            h->handler(i, m, h->arg);
+        /* empty lines carry no command, nothing to dispatch
+         */
+        if (m == NULL || m->command == NULL) {
+            irc_message_unref(m);
+            continue;
         }
-    }
-
-    r = irc_error_success;
 
-cleanup:
+        for (size_t idx = 0; idx < i->handlerlen; idx++) {
+            irc_handler_t *h = i->handler + idx;
 
-    free(line);
-    line = NULL;
+            if (h->cmd[0] == '\0' ||
+                (h->code != irc_command_unknown ?
+                 h->code == m->code :
+                 strcmp(h->cmd, m->command) == 0)) {
+                h->handler(i, m, h->arg);
+            }
+        }
 
-    irc_message_unref(m);
-    m = NULL;
+        irc_message_unref(m);
+    }
 
     return r;
 }
@@ -327,35 +594,80 @@ irc_error_t irc_think(irc_t i)
     return r;
 }
 
-irc_error_t irc_queue(irc_t i, irc_message_t m)
+irc_lane_t irc_lane_default(irc_message_t m)
 {
-    irc_error_t r;
+    return_if_true(m == NULL, irc_lane_interactive);
+
+    switch (m->code) {
+    case irc_command_ping:
+    case irc_command_pong:
+    case irc_command_quit:
+    case irc_command_cap:
+    case irc_command_authenticate:
+        return irc_lane_control;
+
+    default:
+        return irc_lane_interactive;
+    }
+}
 
+irc_error_t irc_queue_lane(irc_t i, irc_lane_t lane, irc_message_t m)
+{
     return_if_true(i == NULL || m == NULL, irc_error_argument);
+    return_if_true((unsigned)lane >= irc_lane_max, irc_error_argument);
 
-    pthread_mutex_lock(&i->sendqmtx);
-    r = irc_queue_push(i->sendq, m);
-    pthread_mutex_unlock(&i->sendqmtx);
+    return irc_sendq_push(i->sendq, lane, m);
+}
 
-    return r;
+irc_error_t irc_queue(irc_t i, irc_message_t m)
+{
+    return irc_queue_lane(i, irc_lane_default(m), m);
 }
 
-irc_error_t irc_queue_command(irc_t i, char const *command, ...)
+static irc_error_t irc_queue_commandv(irc_t i, int lane,
+                                      char const *command, va_list lst)
 {
     irc_message_t m = NULL;
-    va_list lst;
 
     return_if_true(i == NULL || command == NULL, irc_error_argument);
 
-    va_start(lst, command);
-    m = irc_message_makev(i->nick, command, lst);
-    va_end(lst);
-
+    m = irc_message_makev_pool(i->pool, i->nick, command, lst);
     if (m == NULL) {
         return irc_error_memory;
     }
 
-    return irc_queue(i, m);
+    if (lane < 0) {
+        lane = irc_lane_default(m);
+    }
+
+    return irc_queue_lane(i, lane, m);
+}
+
+irc_error_t irc_queue_command(irc_t i, char const *command, ...)
+{
+    irc_error_t r;
+    va_list lst;
+
+    va_start(lst, command);
+    r = irc_queue_commandv(i, -1, command, lst);
+    va_end(lst);
+
+    return r;
+}
+
+irc_error_t irc_queue_command_lane(irc_t i, irc_lane_t lane,
+                                   char const *command, ...)
+{
+    irc_error_t r;
+    va_list lst;
+
+    return_if_true((unsigned)lane >= irc_lane_max, irc_error_argument);
+
+    va_start(lst, command);
+    r = irc_queue_commandv(i, lane, command, lst);
+    va_end(lst);
+
+    return r;
 }
 
 irc_error_t irc_handler_add(irc_t i, char const *cmd,
@@ -371,18 +683,384 @@ irc_error_t irc_handler_add(irc_t i, char const *cmd,
 
     i->handler = tmp;
 
+    memset(i->handler + i->handlerlen, 0, sizeof(irc_handler_t));
     i->handler[i->handlerlen].arg = arg;
     i->handler[i->handlerlen].handler = handler;
     if (cmd != NULL) {
         strncpy(i->handler[i->handlerlen].cmd, cmd,
                 sizeof(i->handler[i->handlerlen].cmd) - 1
             );
+        i->handler[i->handlerlen].code = irc_command_code(cmd, strlen(cmd));
     }
     ++i->handlerlen;
 
     return irc_error_success;
 }
 
+/* Weighted round robin: every lane with a weight may send that many
+ * messages per round, a lane that runs dry forfeits the rest of its turn.
+ * Once no weighted lane has anything left the unweighted ones follow in
+ * order.
+ */
+static irc_message_t irc_pop_next(irc_t i, size_t *lane)
+{
+    irc_message_t m = NULL;
+
+    *lane = irc_lane_control;
+    m = irc_sendq_pop(i->sendq, irc_lane_control);
+    return_if_true(m != NULL, m);
+
+    for (int round = 0; round < 2; round++) {
+        for (size_t l = irc_lane_control + 1; l < irc_lane_max; l++) {
+            if (i->credit[l] == 0) {
+                continue;
+            }
+
+            m = irc_sendq_pop(i->sendq, l);
+            if (m != NULL) {
+                --i->credit[l];
+                *lane = l;
+                return m;
+            }
+            i->credit[l] = 0;
+        }
+
+        for (size_t l = irc_lane_control + 1; l < irc_lane_max; l++) {
+            i->credit[l] = i->weight[l];
+        }
+    }
+
+    for (size_t l = irc_lane_control + 1; l < irc_lane_max; l++) {
+        if (i->weight[l] == 0 &&
+            (m = irc_sendq_pop(i->sendq, l)) != NULL) {
+            *lane = l;
+            return m;
+        }
+    }
+
+    return NULL;
+}
+
+/* Queued JOIN and PART lines without keys or reasons are merged into one
+ * comma separated list, and MODE lines that only give or take o and v on
+ * one channel into a line with several modes. Only what sits next to each
+ * other in one lane is merged, so the order on the wire stays the same.
+ */
+typedef struct {
+    irc_command_t code;
+    /* ":prefix JOIN " or ":prefix MODE #channel "
+     */
+    char head[IRC_LINE_MAX];
+    size_t headlen;
+    /* targets, or mode letters
+     */
+    char list[IRC_LINE_MAX];
+    size_t listlen;
+    /* mode parameters, each with a space in front
+     */
+    char params[IRC_LINE_MAX];
+    size_t paramslen;
+    char sign;
+    /* targets, or mode parameters, and how many there may be
+     */
+    size_t count;
+    size_t limit;
+} irc_coalesce_t;
+
+static bool irc_coalesce_word(char const *s)
+{
+    return (*s != '\0' && *s != ':' && strchr(s, ' ') == NULL);
+}
+
+static bool irc_coalesce_modes(irc_message_t m)
+{
+    size_t letters = 0;
+    char const *modes = m->args[1];
+
+    return_if_true(*modes != '+' && *modes != '-', false);
+
+    for (; *modes != '\0'; modes++) {
+        if (*modes == 'o' || *modes == 'v') {
+            ++letters;
+        } else if (*modes != '+' && *modes != '-') {
+            return false;
+        }
+    }
+
+    return_if_true(letters == 0 || letters != m->argslen - 2, false);
+
+    for (size_t idx = 2; idx < m->argslen; idx++) {
+        return_if_true(!irc_coalesce_word(m->args[idx]), false);
+    }
+
+    return true;
+}
+
+static bool irc_coalesce_candidate(irc_message_t m)
+{
+    return_if_true(m->tags != NULL || m->rawtags.ptr != NULL, false);
+
+    switch (m->code) {
+    case irc_command_join:
+        /* keys would have to line up, and JOIN 0 leaves all channels
+         */
+        return (m->argslen == 1 && irc_coalesce_word(m->args[0]) &&
+                strcmp(m->args[0], "0") != 0);
+
+    case irc_command_part:
+        return (m->argslen == 1 && irc_coalesce_word(m->args[0]));
+
+    case irc_command_mode:
+        return (m->argslen >= 3 && irc_coalesce_modes(m));
+
+    default:
+        return false;
+    }
+}
+
+static bool irc_coalesce_fits(irc_message_t first, irc_message_t m)
+{
+    return_if_true(m->code != first->code, false);
+    return_if_true((m->prefix == NULL) != (first->prefix == NULL), false);
+    return_if_true(m->prefix != NULL && strcmp(m->prefix, first->prefix) != 0,
+                   false);
+    return_if_true(!irc_coalesce_candidate(m), false);
+
+    if (m->code == irc_command_mode) {
+        return (strcmp(m->args[0], first->args[0]) == 0);
+    }
+
+    return true;
+}
+
+static bool irc_coalesce_targets(irc_coalesce_t *c, irc_message_t m)
+{
+    char const *list = m->args[0];
+    size_t len = strlen(list);
+    size_t count = 1;
+    size_t need = len + (c->listlen > 0 ? 1 : 0);
+
+    for (size_t k = 0; k < len; k++) {
+        count += (list[k] == ',');
+    }
+
+    return_if_true(c->limit > 0 && c->count + count > c->limit, false);
+    return_if_true(c->headlen + c->listlen + need + 2 > IRC_LINE_MAX, false);
+
+    if (c->listlen > 0) {
+        c->list[c->listlen++] = ',';
+    }
+    memcpy(c->list + c->listlen, list, len);
+    c->listlen += len;
+    c->count += count;
+
+    return true;
+}
+
+static bool irc_coalesce_modechanges(irc_coalesce_t *c, irc_message_t m)
+{
+    size_t params = m->argslen - 2;
+    size_t need = 0;
+    char sign = c->sign, want = 0;
+
+    return_if_true(c->limit > 0 && c->count + params > c->limit, false);
+
+    /* a sign is only repeated where it changes
+     */
+    for (char const *p = m->args[1]; *p != '\0'; p++) {
+        if (*p == '+' || *p == '-') {
+            want = *p;
+        } else {
+            need += (want != sign ? 2 : 1);
+            sign = want;
+        }
+    }
+    for (size_t idx = 2; idx < m->argslen; idx++) {
+        need += 1 + strlen(m->args[idx]);
+    }
+
+    return_if_true(c->headlen + c->listlen + c->paramslen + need + 2 >
+                   IRC_LINE_MAX, false);
+
+    for (char const *p = m->args[1]; *p != '\0'; p++) {
+        if (*p == '+' || *p == '-') {
+            want = *p;
+            continue;
+        }
+        if (want != c->sign) {
+            c->list[c->listlen++] = want;
+            c->sign = want;
+        }
+        c->list[c->listlen++] = *p;
+    }
+    for (size_t idx = 2; idx < m->argslen; idx++) {
+        size_t len = strlen(m->args[idx]);
+
+        c->params[c->paramslen++] = ' ';
+        memcpy(c->params + c->paramslen, m->args[idx], len);
+        c->paramslen += len;
+    }
+    c->count += params;
+
+    return true;
+}
+
+static bool irc_coalesce_add(irc_coalesce_t *c, irc_message_t m)
+{
+    if (c->code == irc_command_mode) {
+        return irc_coalesce_modechanges(c, m);
+    }
+
+    return irc_coalesce_targets(c, m);
+}
+
+static bool irc_coalesce_start(irc_coalesce_t *c, irc_message_t m,
+                               size_t limit)
+{
+    bool prefix = (m->prefix != NULL);
+    int len = 0;
+
+    c->code = m->code;
+    c->listlen = c->paramslen = 0;
+    c->sign = 0;
+    c->count = 0;
+    c->limit = limit;
+
+    len = snprintf(c->head, sizeof(c->head), "%s%s%s%s %s%s",
+                   (prefix ? ":" : ""), (prefix ? m->prefix : ""),
+                   (prefix ? " " : ""), m->command,
+                   (m->code == irc_command_mode ? m->args[0] : ""),
+                   (m->code == irc_command_mode ? " " : ""));
+    return_if_true(len < 0 || (size_t)len >= sizeof(c->head), false);
+    c->headlen = len;
+
+    return irc_coalesce_add(c, m);
+}
+
+static irc_message_t irc_coalesce_finish(irc_coalesce_t *c, irc_pool_t pool)
+{
+    char line[IRC_LINE_MAX];
+    size_t len = 0;
+    irc_message_view_t v;
+
+    memcpy(line, c->head, c->headlen);
+    len += c->headlen;
+    memcpy(line + len, c->list, c->listlen);
+    len += c->listlen;
+    memcpy(line + len, c->params, c->paramslen);
+    len += c->paramslen;
+
+    if (IRC_FAILED(irc_message_view_parse(&v, line, len))) {
+        return NULL;
+    }
+
+    /* anything past IRC_MESSAGE_MAXARGS would be folded into the last
+     * argument, rather not merge at all then
+     */
+    if (v.argslen != (c->code == irc_command_mode ? 2 + c->count : 1)) {
+        return NULL;
+    }
+
+    return irc_message_view_promote_pool(&v, 0, pool);
+}
+
+static irc_message_t irc_coalesce(irc_t i, irc_message_t m, size_t lane)
+{
+    irc_coalesce_t c;
+    irc_message_t next = NULL, merged = NULL;
+    size_t limit = 0, n = 0;
+
+    return_if_true(!irc_coalesce_candidate(m), m);
+
+    switch (m->code) {
+    case irc_command_join: limit = i->targmax_join; break;
+    case irc_command_part: limit = i->targmax_part; break;
+    default:
+    {
+        /* a merged MODE has to fit into one message with the channel and
+         * the mode letters in front, whatever MODES allows
+         */
+        limit = i->maxmodes;
+        if (limit == 0 || limit > IRC_MESSAGE_MAXARGS - 2) {
+            limit = IRC_MESSAGE_MAXARGS - 2;
+        }
+    } break;
+    }
+
+    return_if_true(!irc_coalesce_start(&c, m, limit), m);
+
+    while ((next = irc_sendq_peek(i->sendq, lane, n)) != NULL &&
+           irc_coalesce_fits(m, next) && irc_coalesce_add(&c, next)) {
+        ++n;
+    }
+    return_if_true(n == 0, m);
+
+    merged = irc_coalesce_finish(&c, i->pool);
+    return_if_true(merged == NULL, m);
+
+    /* only take what went into it once nothing can fail anymore, so the
+     * queue stays as it was otherwise
+     */
+    for (size_t k = 0; k < n; k++) {
+        irc_message_unref(irc_sendq_pop(i->sendq, lane));
+    }
+    irc_message_unref(m);
+
+    return merged;
+}
+
+static irc_message_t irc_pop_head(irc_t i)
+{
+    irc_message_t m = NULL;
+
+    if (i->held == NULL && i->deferred != NULL) {
+        i->held = i->deferred;
+        i->heldlane = i->deferredlane;
+        i->deferred = NULL;
+    }
+
+    if (i->held != NULL) {
+        /* a line waiting for flood control must not hold up a PONG that
+         * was queued after it
+         */
+        if (i->heldlane != irc_lane_control && i->deferred == NULL &&
+            (m = irc_sendq_pop(i->sendq, irc_lane_control)) != NULL) {
+            i->deferred = i->held;
+            i->deferredlane = i->heldlane;
+            i->held = m;
+            i->heldlane = irc_lane_control;
+        }
+        return i->held;
+    }
+
+    i->held = irc_pop_next(i, &i->heldlane);
+    if (i->held == NULL) {
+        /* everything looked empty, arm the descriptor and look again for
+         * what came in meanwhile
+         */
+        irc_sendq_arm(i->sendq);
+        i->held = irc_pop_next(i, &i->heldlane);
+    }
+
+    if (i->held != NULL && i->coalesce) {
+        i->held = irc_coalesce(i, i->held, i->heldlane);
+    }
+
+    return i->held;
+}
+
+static uint64_t irc_pop_delay(irc_t i, irc_message_t m)
+{
+    ssize_t len = 0;
+
+    return_if_true(i->flood == NULL, 0);
+
+    len = irc_message_serialize_into(m, NULL, 0);
+    return_if_true(len < 0, 0);
+
+    return irc_flood_delay(i->flood, len, irc_flood_now());
+}
+
 irc_error_t irc_pop(irc_t i, char **message, size_t *len)
 {
     irc_message_t msg = NULL;
@@ -390,11 +1068,30 @@ irc_error_t irc_pop(irc_t i, char **message, size_t *len)
 
     return_if_true(i == NULL, irc_error_argument);
 
-    pthread_mutex_lock(&i->sendqmtx);
-    msg = irc_queue_pop(i->sendq);
-    pthread_mutex_unlock(&i->sendqmtx);
+    pthread_mutex_lock(&i->popmtx);
+
+    msg = irc_pop_head(i);
+    if (msg == NULL) {
+        pthread_mutex_unlock(&i->popmtx);
+        return irc_error_nodata;
+    }
 
-    return_if_true(msg == NULL, irc_error_nodata);
+    if (i->flood != NULL) {
+        ssize_t need = irc_message_serialize_into(msg, NULL, 0);
+
+        if (need >= 0 &&
+            IRC_FAILED(irc_flood_take(i->flood, need, irc_flood_now()))) {
+            /* nothing can go out before the deadline, so the descriptor
+             * must not keep an event loop spinning until then
+             */
+            irc_sendq_quiet(i->sendq);
+            pthread_mutex_unlock(&i->popmtx);
+            return irc_error_again;
+        }
+    }
+    i->held = NULL;
+
+    pthread_mutex_unlock(&i->popmtx);
 
     r = irc_message_string(msg, message, len);
     irc_message_unref(msg);
@@ -402,6 +1099,79 @@ irc_error_t irc_pop(irc_t i, char **message, size_t *len)
     return r;
 }
 
+int irc_queue_fd(irc_t i)
+{
+    return_if_true(i == NULL, -1);
+    return irc_sendq_fd(i->sendq);
+}
+
+int irc_pop_timeout(irc_t i)
+{
+    irc_message_t m = NULL;
+    uint64_t delay = 0;
+
+    return_if_true(i == NULL, -1);
+
+    pthread_mutex_lock(&i->popmtx);
+    m = irc_pop_head(i);
+    if (m != NULL) {
+        delay = irc_pop_delay(i, m);
+        if (delay > 0) {
+            irc_sendq_quiet(i->sendq);
+        }
+    }
+    pthread_mutex_unlock(&i->popmtx);
+
+    return_if_true(m == NULL, -1);
+    return (delay > INT_MAX ? INT_MAX : (int)delay);
+}
+
+irc_error_t irc_pop_wait(irc_t i, char **message, size_t *len, int timeout)
+{
+    struct pollfd pfd;
+    irc_error_t r = irc_error_success;
+
+    return_if_true(i == NULL, irc_error_argument);
+
+    pfd.fd = irc_sendq_fd(i->sendq);
+    pfd.events = POLLIN;
+
+    /* irc_pop() arms the descriptor whenever it comes up empty
+     */
+    while ((r = irc_pop(i, message, len)) == irc_error_nodata ||
+           r == irc_error_again) {
+        int ret = 0;
+
+        if (r == irc_error_again) {
+            /* nothing queued later could go out any sooner
+             */
+            int delay = irc_pop_timeout(i);
+
+            if (delay < 0) {
+                /* whatever was held went away, irc_reset() perhaps
+                 */
+                continue;
+            }
+            if (timeout >= 0 && delay > timeout) {
+                poll(NULL, 0, timeout);
+                return irc_error_again;
+            }
+            ret = poll(NULL, 0, delay);
+        } else {
+            ret = poll(&pfd, 1, timeout);
+            if (ret == 0) {
+                return irc_error_nodata;
+            }
+        }
+
+        if (ret < 0 && errno != EINTR) {
+            return irc_error_io;
+        }
+    }
+
+    return r;
+}
+
 irc_error_t irc_connected(irc_t i)
 {
     return_if_true(i == NULL, irc_error_argument);
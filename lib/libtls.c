@@ -2,6 +2,7 @@
 
 #include <tls.h>
 #include <stdlib.h>
+#include <string.h>
 
 typedef struct {
     struct tls *tls;
@@ -122,3 +123,74 @@ int irc_ssl_client_write(void *arg, void const *buffer, size_t size)
 
     return ret;
 }
+
+/* tls_write() may take only part of a buffer, or ask to be called again.
+ * Returns how much went out, which is less than size only on error.
+ */
+static size_t libtls_write_all(libtls_t *c, char const *buffer, size_t size)
+{
+    size_t done = 0;
+
+    while (done < size) {
+        ssize_t ret = tls_write(c->tls, buffer + done, size - done);
+
+        if (ret == TLS_WANT_POLLIN || ret == TLS_WANT_POLLOUT) {
+            continue;
+        }
+        if (ret < 0) {
+            break;
+        }
+        done += ret;
+    }
+
+    return done;
+}
+
+int irc_ssl_client_writev(void *arg, struct iovec const *iov, int iovcnt)
+{
+    libtls_t *c = (libtls_t*)arg;
+    char buf[4096];
+    size_t len = 0;
+    int total = 0;
+
+    return_if_true(c == NULL || c->tls == NULL, -1);
+
+    /* libtls has no gathering write, so small pieces are collected in one
+     * buffer to not send a record per piece. Should a piece only go out in
+     * part, what did go out is reported, so nothing is sent twice.
+     */
+    for (int i = 0; i < iovcnt; i++) {
+        size_t ret = 0;
+
+        if (len + iov[i].iov_len > sizeof(buf) && len > 0) {
+            ret = libtls_write_all(c, buf, len);
+            total += ret;
+            if (ret < len) {
+                return (total > 0 ? total : -1);
+            }
+            len = 0;
+        }
+
+        if (iov[i].iov_len > sizeof(buf)) {
+            ret = libtls_write_all(c, iov[i].iov_base, iov[i].iov_len);
+            total += ret;
+            if (ret < iov[i].iov_len) {
+                return (total > 0 ? total : -1);
+            }
+        } else {
+            memcpy(buf + len, iov[i].iov_base, iov[i].iov_len);
+            len += iov[i].iov_len;
+        }
+    }
+
+    if (len > 0) {
+        size_t ret = libtls_write_all(c, buf, len);
+
+        total += ret;
+        if (ret < len) {
+            return (total > 0 ? total : -1);
+        }
+    }
+
+    return total;
+}
@@ -1,9 +1,80 @@
 #define _GNU_SOURCE
 #include <irc/message.h>
 #include <irc/util.h>
-#include <irc/strbuf.h>
+#include "scan.h"
 
 #include <string.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* Perfect hash over the known verbs, every one of them lands in its own
+ * slot. Anything else is looked up and compared as well, and falls through
+ * as unknown.
+ */
+#define IRC_COMMAND_HASH(s, l) \
+    ((((s)[0] * 9) + ((s)[1] * 5) + ((s)[(l) - 1] * 53) + (l)) & 63)
+
+static struct {
+    char const *name;
+    size_t len;
+    irc_command_t code;
+} const irc_commands[64] = {
+    [1] = { "LIST", 4, irc_command_list },
+    [3] = { "ACCOUNT", 7, irc_command_account },
+    [4] = { "BATCH", 5, irc_command_batch },
+    [6] = { "ERROR", 5, irc_command_error },
+    [7] = { "AUTHENTICATE", 12, irc_command_authenticate },
+    [8] = { "PASS", 4, irc_command_pass },
+    [10] = { "WALLOPS", 7, irc_command_wallops },
+    [13] = { "MODE", 4, irc_command_mode },
+    [15] = { "JOIN", 4, irc_command_join },
+    [16] = { "KILL", 4, irc_command_kill },
+    [18] = { "PONG", 4, irc_command_pong },
+    [20] = { "SETNAME", 7, irc_command_setname },
+    [21] = { "WHO", 3, irc_command_who },
+    [24] = { "NOTICE", 6, irc_command_notice },
+    [26] = { "USER", 4, irc_command_user },
+    [27] = { "KICK", 4, irc_command_kick },
+    [35] = { "TOPIC", 5, irc_command_topic },
+    [36] = { "PRIVMSG", 7, irc_command_privmsg },
+    [38] = { "INVITE", 6, irc_command_invite },
+    [41] = { "SQUIT", 5, irc_command_squit },
+    [42] = { "QUIT", 4, irc_command_quit },
+    [43] = { "WHOIS", 5, irc_command_whois },
+    [45] = { "AWAY", 4, irc_command_away },
+    [46] = { "CHGHOST", 7, irc_command_chghost },
+    [50] = { "TAGMSG", 6, irc_command_tagmsg },
+    [51] = { "CAP", 3, irc_command_cap },
+    [52] = { "PING", 4, irc_command_ping },
+    [54] = { "NICK", 4, irc_command_nick },
+    [55] = { "NAMES", 5, irc_command_names },
+    [61] = { "PART", 4, irc_command_part },
+};
+
+irc_command_t irc_command_code(char const *cmd, size_t len)
+{
+    unsigned char const *s = (unsigned char const *)cmd;
+    size_t h = 0;
+
+    return_if_true(cmd == NULL || len < 3, irc_command_unknown);
+
+    if (len == 3 &&
+        s[0] >= '0' && s[0] <= '9' &&
+        s[1] >= '0' && s[1] <= '9' &&
+        s[2] >= '0' && s[2] <= '9') {
+        return (s[0] - '0') * 100 + (s[1] - '0') * 10 + (s[2] - '0');
+    }
+
+    h = IRC_COMMAND_HASH(s, len);
+    if (irc_commands[h].len == len &&
+        memcmp(irc_commands[h].name, cmd, len) == 0) {
+        return irc_commands[h].code;
+    }
+
+    return irc_command_unknown;
+}
 
 irc_message_t irc_message_new(void)
 {
@@ -13,7 +84,7 @@ irc_message_t irc_message_new(void)
         return NULL;
     }
 
-    m->ref = 1;
+    atomic_init(&m->ref, 1);
 
     return m;
 }
@@ -24,7 +95,36 @@ void irc_message_ref(irc_message_t m)
         return;
     }
 
-    ++m->ref;
+    atomic_fetch_add_explicit(&m->ref, 1, memory_order_relaxed);
+}
+
+/* All messages of a batch live in one arena, which goes away with the last
+ * of them.
+ */
+struct irc_message_arena_
+{
+    atomic_int ref;
+};
+
+#define IRC_MESSAGE_ALIGN(s)                                            \
+    (((s) + _Alignof(max_align_t) - 1) & ~(_Alignof(max_align_t) - 1))
+
+static void irc_message_arena_unref(struct irc_message_arena_ *a)
+{
+    if (atomic_fetch_sub_explicit(&a->ref, 1, memory_order_acq_rel) > 1) {
+        return;
+    }
+
+    free(a);
+}
+
+static void irc_message_block_free(irc_message_t m, void *block)
+{
+    if (m->flags & irc_message_flag_pooled) {
+        irc_pool_release(block);
+    } else {
+        free(block);
+    }
 }
 
 void irc_message_unref(irc_message_t m)
@@ -33,9 +133,35 @@ void irc_message_unref(irc_message_t m)
         return;
     }
 
-    --m->ref;
+    /* whoever drops the last reference has to see everything the others
+     * did to the message before
+     */
+    if (atomic_fetch_sub_explicit(&m->ref, 1, memory_order_acq_rel) > 1) {
+        return;
+    }
+
+    if (m->flags & irc_message_flag_lazytags) {
+        /* decoded on demand, in one allocation of their own
+         */
+        irc_message_block_free(m, m->tags);
+        m->tags = NULL;
+        m->tagslen = 0;
+
+        if (!(m->flags & irc_message_flag_packed)) {
+            free((char *)m->rawtags.ptr);
+        }
+        m->rawtags.ptr = NULL;
+    }
+
+    /* everything lives in the same allocation as the message itself
+     */
+    if (m->arena != NULL) {
+        irc_message_arena_unref(m->arena);
+        return;
+    }
 
-    if (m->ref > 0) {
+    if (m->flags & irc_message_flag_packed) {
+        irc_message_block_free(m, m);
         return;
     }
 
@@ -76,144 +202,326 @@ irc_message_t irc_message_parse2(char const *line, size_t linesize)
 }
 
 
-static void irc_message_add2(char ***ac, size_t *av, char const *s)
+/* Returns the next space separated word at or after *pos, and moves *pos
+ * past it. The spaces come from a vectorised scan of the whole line, so
+ * finding a word costs no more than walking the bits of a mask. The input
+ * is never modified, so it may point straight into a receive buffer that is
+ * neither copied nor NUL terminated.
+ */
+static char const *irc_message_word(irc_scan_t *sc, size_t *pos,
+                                    size_t *wordlen)
 {
-    char *dup = NULL;
+    size_t sep = 0;
+
+    while (*pos < sc->len) {
+        sep = irc_scan_next(sc);
+        if (sep > *pos) {
+            char const *word = sc->buf + *pos;
 
-    dup = strdup(s);
-    irc_strv_add(ac, av, dup);
+            *wordlen = sep - *pos;
+            *pos = sep + 1;
+
+            return word;
+        }
+        *pos = sep + 1;
+    }
+
+    return NULL;
 }
 
-static void irc_message_add(char ***ac, size_t *av, strbuf_t b, bool final)
+irc_error_t irc_message_view_parse(irc_message_view_t *v, char const *l,
+                                   size_t len)
 {
-    char *dup = NULL;
+    irc_scan_t sc;
+    char const *end = NULL;
+    char const *part = NULL;
+    size_t partlen = 0;
+    size_t pos = 0;
+
+    return_if_true(v == NULL || l == NULL, irc_error_argument);
+
+    memset(v, 0, sizeof(*v));
 
-    if (final == false) {
-        if (strbuf_getc(b) == ':') {
-            strbuf_delete(b, 1);
+    /* a length of -1 means the line is NUL terminated
+     */
+    end = l + strnlen(l, len);
+    irc_scan_spaces(&sc, l, end - l);
+
+    part = irc_message_word(&sc, &pos, &partlen);
+
+    /* check if we actually have tags or a prefix. Tags start with '@'
+     * and prefix start with ':' and if we don't have one, we assume
+     * the first part is the command.
+     */
+    if (part != NULL && *part == '@') {
+        v->tags.ptr = part + 1;
+        v->tags.len = partlen - 1;
+        part = irc_message_word(&sc, &pos, &partlen);
+    }
+
+    if (part != NULL && *part == ':') {
+        v->prefix.ptr = part + 1;
+        v->prefix.len = partlen - 1;
+        part = irc_message_word(&sc, &pos, &partlen);
+    }
+
+    if (part == NULL) {
+        return irc_error_success;
+    }
+
+    v->command.ptr = part;
+    v->command.len = partlen;
+    v->code = irc_command_code(part, partlen);
+
+    while ((part = irc_message_word(&sc, &pos, &partlen)) != NULL) {
+        irc_slice_t *arg = v->args + v->argslen++;
+
+        /* the final argument runs until the end of the line, spaces and
+         * all. As in RFC 2812 the last possible argument is always final,
+         * even without the ':'.
+         */
+        if (*part == ':' || v->argslen == IRC_MESSAGE_MAXARGS) {
+            if (*part == ':') {
+                ++part;
+            }
+            arg->ptr = part;
+            arg->len = end - part;
+            break;
         }
+
+        arg->ptr = part;
+        arg->len = partlen;
+    }
+
+    return irc_error_success;
+}
+
+static bool irc_message_next_tag(irc_slice_t const *tags, char const **pos,
+                                 irc_slice_t *key, irc_slice_t *value)
+{
+    char const *end = tags->ptr + tags->len;
+    char const *tag = *pos;
+    char const *sep = NULL;
+    char const *eq = NULL;
+
+    if (tag == NULL) {
+        return false;
+    }
+
+    sep = memchr(tag, ';', end - tag);
+    if (sep == NULL) {
+        sep = end;
+        *pos = NULL;
+    } else {
+        *pos = sep + 1;
+    }
+
+    eq = memchr(tag, '=', sep - tag);
+    if (eq == NULL) {
+        key->ptr = tag;
+        key->len = sep - tag;
+        value->ptr = NULL;
+        value->len = 0;
+    } else {
+        key->ptr = tag;
+        key->len = eq - tag;
+        value->ptr = eq + 1;
+        value->len = sep - eq - 1;
+    }
+
+    return true;
+}
+
+bool irc_message_view_tag(irc_message_view_t const *v, char const **pos,
+                          irc_slice_t *key, irc_slice_t *value)
+{
+    return_if_true(v == NULL || pos == NULL, false);
+    return irc_message_next_tag(&v->tags, pos, key, value);
+}
+
+bool irc_message_view_is(irc_message_view_t const *v, char const *cmd)
+{
+    return_if_true(v == NULL || v->command.ptr == NULL, false);
+    return (strlen(cmd) == v->command.len &&
+            memcmp(v->command.ptr, cmd, v->command.len) == 0);
+}
+
+bool irc_message_view_arg_is(irc_message_view_t const *v, size_t idx,
+                             char const *what)
+{
+    return_if_true(v == NULL, false);
+    return_if_true(idx >= v->argslen, false);
+    return (strlen(what) == v->args[idx].len &&
+            memcmp(v->args[idx].ptr, what, v->args[idx].len) == 0);
+}
+
+static char *irc_message_slice_dup(irc_slice_t const *s)
+{
+    return strndup(s->ptr, s->len);
+}
+
+static void irc_message_prefix_split(irc_prefix_t *s, char const *p)
+{
+    size_t len = 0;
+    size_t nick = 0;
+    char const *at = NULL;
+
+    /* the result stays tied to the string it was taken from
+     */
+    memset(s, 0, sizeof(*s));
+    s->of = p;
+
+    return_if_true(p == NULL,);
+
+    while (*p == ':') {
+        ++p;
+    }
+
+    len = strlen(p);
+    nick = strcspn(p, "!@");
+
+    s->nick.ptr = p;
+    s->nick.len = nick;
+
+    at = memchr(p + nick, '@', len - nick);
+    if (p[nick] == '!') {
+        s->user.ptr = p + nick + 1;
+        s->user.len = (at != NULL ? at : p + len) - s->user.ptr;
     }
+    if (at != NULL) {
+        s->host.ptr = at + 1;
+        s->host.len = (p + len) - s->host.ptr;
+    }
+}
+
+static void irc_message_tags_index(irc_message_t m)
+{
+    irc_tag_index_t *idx = &m->tagindex;
 
-    dup = strbuf_strdup(b);
-    irc_strv_add(ac, av, dup);
+    memset(idx, 0, sizeof(*idx));
+    idx->of = m->tags;
+    idx->len = m->tagslen;
+
+    for (size_t i = 0; i < m->tagslen && i < USHRT_MAX; i++) {
+        char const *k = m->tags[i]->key;
+        irc_tag_key_t key = irc_tag_key(k, strlen(k));
+
+        /* the first one wins, as with a plain search
+         */
+        if (key != irc_tag_key_unknown && idx->slot[key] == 0) {
+            idx->slot[key] = i + 1;
+        }
+    }
 }
 
 irc_error_t irc_message_parse(irc_message_t c, char const *l, size_t len)
 {
-    strbuf_t argbuf = NULL;
-    char *prefix = NULL, *command = NULL;
+    irc_message_view_t v;
+    char *prefix = NULL, *command = NULL, *rawtags = NULL;
     char **args = NULL;
     size_t argslen = 0;
     irc_tag_t *tags = NULL;
     size_t tagslen = 0;
-
-    char *line = len < 0 ? strdup(l) : strndup(l, len);
-    char *ptr = line;
-    char *part = NULL;
     irc_error_t r = irc_error_memory;
-    size_t i = 0;
-    bool final = false;
 
-    while ((part = strsep(&line, " ")) != NULL) {
-        if (*part == '\0') {
-            ++part;
-            continue;
+    return_if_true(c == NULL || l == NULL, irc_error_argument);
+
+    irc_message_view_parse(&v, l, len);
+
+    if ((c->flags & irc_message_flag_lazytags) && v.tags.ptr != NULL) {
+        /* only keep the raw tags, irc_message_tags_decode() does the rest
+         */
+        rawtags = irc_message_slice_dup(&v.tags);
+        if (rawtags == NULL) {
+            goto cleanup;
         }
+    } else if (v.tags.ptr != NULL) {
+        irc_slice_t key, value;
+        char const *pos = v.tags.ptr;
 
-        switch (i) {
-        case 0:
-        {
-            /* check if we actually have tags or a prefix. Tags start with '@'
-             * and prefix start with ':' and if we don't have one, we assume
-             * the first part is the command and move past the command thing.
-             */
-            if (*part == '@') {
-                char *tmp = strdup(part + 1);
-                char *tmp_ptr = tmp;
-                char *tag = NULL;
-
-                while ((tag = strsep(&tmp, ";")) != NULL) {
-                    irc_tag_t t = irc_tag_new();
-                    if (t == NULL) {
-                        goto cleanup;
-                    }
-
-                    r = irc_tag_parse(t, tag);
-                    if (IRC_FAILED(r)) {
-                        irc_tag_free(t);
-                        free(tmp_ptr);
-                        goto cleanup;
-                    }
-
-                    tags = realloc(tags, sizeof(irc_tag_t) * (tagslen + 1));
-                    tags[tagslen++] = t;
-                }
-                free(tmp_ptr);
-                continue;
+        while (irc_message_view_tag(&v, &pos, &key, &value)) {
+            irc_tag_t t = NULL;
+            irc_tag_t *tmp = NULL;
+
+            tmp = realloc(tags, sizeof(irc_tag_t) * (tagslen + 1));
+            if (tmp == NULL) {
+                goto cleanup;
             }
-            else if (*part == ':') {
-                prefix = strdup(part + 1);
-            } else {
-                command = strdup(part);
-                ++i;
+            tags = tmp;
+
+            t = irc_tag_new();
+            if (t == NULL) {
+                goto cleanup;
             }
-        } break;
+            tags[tagslen++] = t;
 
-        case 1: command = strdup(part); break;
+            t->key = irc_message_slice_dup(&key);
+            if (t->key == NULL) {
+                goto cleanup;
+            }
 
-        default:
-        {
-            if (*part == ':') {
-                if (argbuf == NULL) {
-                    argbuf = strbuf_new();
-                    if (argbuf == NULL) {
-                        goto cleanup;
-                    }
+            if (value.len > 0) {
+                t->value = malloc(value.len + 1);
+                if (t->value == NULL) {
+                    goto cleanup;
                 }
+                value.len = irc_tag_unescape_into(t->value, value.ptr,
+                                                  value.len);
+                t->value[value.len] = '\0';
 
-                if (final == false) {
-                    strbuf_append(argbuf, part + 1, strlen(part) - 1);
-                    final = true;
-                } else {
-                    strbuf_append(argbuf, " ", 1);
-                    strbuf_append(argbuf, part, strlen(part));
-                }
-            } else {
-                if (argbuf == NULL) {
-                    irc_message_add2(&args, &argslen, part);
-                } else {
-                    strbuf_append(argbuf, " ", 1);
-                    strbuf_append(argbuf, part, strlen(part));
+                if (value.len == 0) {
+                    free(t->value);
+                    t->value = NULL;
                 }
             }
+        }
+    }
 
-        } break;
+    if (v.prefix.ptr != NULL) {
+        prefix = irc_message_slice_dup(&v.prefix);
+        if (prefix == NULL) {
+            goto cleanup;
         }
+    }
 
-        ++i;
+    if (v.command.ptr != NULL) {
+        command = irc_message_slice_dup(&v.command);
+        if (command == NULL) {
+            goto cleanup;
+        }
     }
 
-    /* Check if their is remaining argument
-     */
-    if (argbuf) {
-        irc_message_add(&args, &argslen, argbuf, final);
+    for (size_t i = 0; i < v.argslen; i++) {
+        char *arg = irc_message_slice_dup(v.args + i);
+
+        if (arg == NULL) {
+            goto cleanup;
+        }
+
+        if (IRC_FAILED(irc_strv_add(&args, &argslen, arg))) {
+            free(arg);
+            goto cleanup;
+        }
     }
 
     c->prefix = prefix;
     c->command = command;
+    c->code = v.code;
+    irc_message_prefix_split(&c->source, c->prefix);
     c->args = args;
     c->argslen = argslen;
     c->tags = tags;
     c->tagslen = tagslen;
+    irc_message_tags_index(c);
+    c->rawtags.ptr = rawtags;
+    c->rawtags.len = v.tags.len;
 
     r = irc_error_success;
 
 cleanup:
 
-    strbuf_free(argbuf);
-    argbuf = NULL;
-
     if (r != irc_error_success) {
+        free(rawtags);
         free(prefix);
         free(command);
         irc_strv_free(args);
@@ -225,28 +533,444 @@ cleanup:
         tags = NULL;
     }
 
-    free(ptr);
+    return r;
+}
+
+static char *irc_message_pack(char **pos, char const *s, size_t len)
+{
+    char *str = *pos;
+
+    memcpy(str, s, len);
+    str[len] = '\0';
+    *pos += len + 1;
+
+    return str;
+}
+
+/* Returns how much room the decoded tags of a raw tag slice take up, as
+ * laid out by irc_message_tags_pack().
+ */
+static size_t irc_message_tags_size(irc_slice_t const *raw, size_t *tagslen)
+{
+    irc_slice_t key, value;
+    char const *pos = raw->ptr;
+    size_t size = 0;
+
+    *tagslen = 0;
+
+    while (irc_message_next_tag(raw, &pos, &key, &value)) {
+        size += sizeof(irc_tag_t) + sizeof(struct irc_tag_);
+        size += key.len + 1;
+        if (value.len > 0) {
+            size += value.len + 1;
+        }
+        ++(*tagslen);
+    }
+
+    return size;
+}
+
+/* Decodes the raw tags into mem as tag vector, tags and strings, and
+ * returns the first byte past them.
+ */
+static char *irc_message_tags_pack(irc_slice_t const *raw, size_t tagslen,
+                                   char *mem)
+{
+    irc_tag_t *tags = (irc_tag_t *)mem;
+    struct irc_tag_ *tag = (struct irc_tag_ *)(tags + tagslen);
+    char *str = (char *)(tag + tagslen);
+    char const *pos = raw->ptr;
+    irc_slice_t key, value;
+
+    for (size_t i = 0; i < tagslen; i++, tag++) {
+        irc_message_next_tag(raw, &pos, &key, &value);
+
+        tags[i] = tag;
+        tag->key = irc_message_pack(&str, key.ptr, key.len);
+        tag->value = NULL;
+        if (value.len > 0) {
+            value.len = irc_tag_unescape_into(str, value.ptr, value.len);
+            if (value.len > 0) {
+                tag->value = str;
+            }
+            str[value.len] = '\0';
+            str += value.len + 1;
+        }
+    }
+
+    return str;
+}
+
+irc_message_t irc_message_view_promote(irc_message_view_t const *v,
+                                       unsigned int flags)
+{
+    return irc_message_view_promote_pool(v, flags, NULL);
+}
+
+/* Works out how much room a packed message for v needs: header, argument
+ * vector, tags and strings.
+ */
+static size_t irc_message_view_size(irc_message_view_t const *v,
+                                    unsigned int flags, size_t *tagslen)
+{
+    size_t size = sizeof(struct irc_message_);
+
+    *tagslen = 0;
+
+    if (flags & irc_message_flag_lazytags) {
+        size += (v->tags.ptr != NULL ? v->tags.len + 1 : 0);
+    } else if (v->tags.ptr != NULL) {
+        size += irc_message_tags_size(&v->tags, tagslen);
+    }
+
+    if (v->argslen > 0) {
+        size += (v->argslen + 1) * sizeof(char*);
+    }
+
+    size += (v->prefix.ptr != NULL ? v->prefix.len + 1 : 0);
+    size += (v->command.ptr != NULL ? v->command.len + 1 : 0);
+    for (size_t i = 0; i < v->argslen; i++) {
+        size += v->args[i].len + 1;
+    }
+
+    return size;
+}
+
+static irc_message_t irc_message_view_layout(irc_message_view_t const *v,
+                                             unsigned int flags,
+                                             size_t tagslen, void *mem)
+{
+    irc_message_t m = mem;
+    char *str = NULL;
+
+    memset(m, 0, sizeof(struct irc_message_));
+
+    atomic_init(&m->ref, 1);
+    m->flags = irc_message_flag_packed | flags;
+
+    str = (char *)(m + 1);
+
+    if (v->argslen > 0) {
+        m->args = (char **)str;
+        m->argslen = v->argslen;
+        str += (v->argslen + 1) * sizeof(char*);
+    }
+
+    if (flags & irc_message_flag_lazytags) {
+        if (v->tags.ptr != NULL) {
+            m->rawtags.len = v->tags.len;
+            m->rawtags.ptr = irc_message_pack(&str, v->tags.ptr, v->tags.len);
+        }
+    } else if (tagslen > 0) {
+        m->tags = (irc_tag_t *)str;
+        m->tagslen = tagslen;
+        str = irc_message_tags_pack(&v->tags, tagslen, str);
+        irc_message_tags_index(m);
+    }
+
+    if (v->prefix.ptr != NULL) {
+        m->prefix = irc_message_pack(&str, v->prefix.ptr, v->prefix.len);
+        irc_message_prefix_split(&m->source, m->prefix);
+    }
+
+    if (v->command.ptr != NULL) {
+        m->command = irc_message_pack(&str, v->command.ptr, v->command.len);
+        m->code = v->code;
+    }
+
+    for (size_t i = 0; i < v->argslen; i++) {
+        m->args[i] = irc_message_pack(&str, v->args[i].ptr, v->args[i].len);
+    }
+    if (m->args != NULL) {
+        m->args[v->argslen] = NULL;
+    }
+
+    return m;
+}
+
+irc_message_t irc_message_view_promote_pool(irc_message_view_t const *v,
+                                            unsigned int flags,
+                                            irc_pool_t pool)
+{
+    size_t tagslen = 0;
+    size_t size = 0;
+    void *mem = NULL;
+
+    return_if_true(v == NULL, NULL);
+
+    flags &= irc_message_flag_lazytags;
+    if (pool != NULL) {
+        flags |= irc_message_flag_pooled;
+    }
+
+    size = irc_message_view_size(v, flags, &tagslen);
+    mem = irc_pool_alloc(pool, size);
+    if (mem == NULL) {
+        return NULL;
+    }
+
+    return irc_message_view_layout(v, flags, tagslen, mem);
+}
+
+irc_error_t irc_message_parse_batch(struct iovec const *lines, size_t n,
+                                    irc_message_t *msgs, unsigned int flags)
+{
+    struct irc_message_arena_ *arena = NULL;
+    irc_message_view_t *views = NULL;
+    size_t *sizes = NULL;
+    size_t size = IRC_MESSAGE_ALIGN(sizeof(struct irc_message_arena_));
+    size_t parsed = 0;
+    char *mem = NULL;
+
+    return_if_true(msgs == NULL || (lines == NULL && n > 0),
+                   irc_error_argument);
+    return_if_true(n == 0, irc_error_success);
+
+    /* views, and then size and number of tags for each of them
+     */
+    views = malloc(n * (sizeof(irc_message_view_t) + 2 * sizeof(size_t)));
+    if (views == NULL) {
+        return irc_error_memory;
+    }
+    sizes = (size_t *)(views + n);
+
+    flags &= irc_message_flag_lazytags;
+
+    /* parse everything first, so the whole batch gets one allocation
+     */
+    for (size_t i = 0; i < n; i++) {
+        msgs[i] = NULL;
+        sizes[2 * i] = 0;
+
+        if (IRC_FAILED(irc_message_view_parse(views + i, lines[i].iov_base,
+                                              lines[i].iov_len))) {
+            continue;
+        }
+
+        sizes[2 * i] = IRC_MESSAGE_ALIGN(
+            irc_message_view_size(views + i, flags, sizes + 2 * i + 1)
+            );
+        size += sizes[2 * i];
+        ++parsed;
+    }
+
+    if (parsed == 0) {
+        free(views);
+        return irc_error_success;
+    }
+
+    arena = malloc(size);
+    if (arena == NULL) {
+        free(views);
+        return irc_error_memory;
+    }
+    atomic_init(&arena->ref, parsed);
+
+    mem = (char *)arena + IRC_MESSAGE_ALIGN(sizeof(struct irc_message_arena_));
+    for (size_t i = 0; i < n; i++) {
+        if (sizes[2 * i] == 0) {
+            continue;
+        }
+
+        msgs[i] = irc_message_view_layout(views + i, flags,
+                                          sizes[2 * i + 1], mem);
+        msgs[i]->arena = arena;
+        mem += sizes[2 * i];
+    }
+
+    free(views);
+
+    return irc_error_success;
+}
+
+void irc_message_unref_batch(irc_message_t *msgs, size_t n)
+{
+    return_if_true(msgs == NULL,);
+
+    for (size_t i = 0; i < n; i++) {
+        irc_message_unref(msgs[i]);
+        msgs[i] = NULL;
+    }
+}
+
+/* Lazy tags may be decoded by several threads sharing the message at once,
+ * only one of them gets to do it. This happens once per message at most, so
+ * one lock for all of them does.
+ */
+static pthread_mutex_t irc_message_decodemtx = PTHREAD_MUTEX_INITIALIZER;
+
+static bool irc_message_tags_pending(irc_message_t m)
+{
+    return (m->flags & irc_message_flag_lazytags) &&
+        m->rawtags.ptr != NULL &&
+        !atomic_load_explicit(&m->tagsready, memory_order_acquire);
+}
+
+irc_error_t irc_message_tags_decode(irc_message_t m)
+{
+    irc_error_t r = irc_error_success;
+    size_t tagslen = 0;
+    size_t size = 0;
+    char *mem = NULL;
+
+    return_if_true(m == NULL, irc_error_argument);
+
+    if (!irc_message_tags_pending(m)) {
+        return irc_error_success;
+    }
+
+    pthread_mutex_lock(&irc_message_decodemtx);
+    if (atomic_load_explicit(&m->tagsready, memory_order_relaxed)) {
+        goto cleanup;
+    }
+
+    /* the decoded tags get one allocation of their own
+     */
+    size = irc_message_tags_size(&m->rawtags, &tagslen);
+    if (m->flags & irc_message_flag_pooled) {
+        mem = irc_pool_alloc(irc_pool_owner(m), size);
+    } else {
+        mem = malloc(size);
+    }
+    if (mem == NULL) {
+        r = irc_error_memory;
+        goto cleanup;
+    }
+    irc_message_tags_pack(&m->rawtags, tagslen, mem);
+
+    m->tags = (irc_tag_t *)mem;
+    m->tagslen = tagslen;
+    irc_message_tags_index(m);
+
+    atomic_store_explicit(&m->tagsready, true, memory_order_release);
+
+cleanup:
+
+    pthread_mutex_unlock(&irc_message_decodemtx);
 
     return r;
 }
 
+irc_tag_t irc_message_tag_known(irc_message_t m, irc_tag_key_t key)
+{
+    irc_tag_index_t const *idx = NULL;
+
+    return_if_true(m == NULL, NULL);
+    return_if_true(key <= irc_tag_key_unknown || key >= irc_tag_key_max,
+                   NULL);
+
+    if (IRC_FAILED(irc_message_tags_decode(m))) {
+        return NULL;
+    }
+
+    /* as with the prefix, only packed messages can tell for sure that
+     * their tags were not replaced since the index was built
+     */
+    idx = &m->tagindex;
+    if ((m->flags & irc_message_flag_packed) &&
+        idx->of == m->tags && idx->len == m->tagslen) {
+        return (idx->slot[key] > 0 ? m->tags[idx->slot[key] - 1] : NULL);
+    }
+
+    for (size_t i = 0; i < m->tagslen; i++) {
+        char const *k = m->tags[i]->key;
+
+        if (irc_tag_key(k, strlen(k)) == key) {
+            return m->tags[i];
+        }
+    }
+
+    return NULL;
+}
+
+irc_tag_t irc_message_tag_get(irc_message_t m, char const *key)
+{
+    irc_tag_key_t known = irc_tag_key_unknown;
+    size_t len = 0;
+
+    return_if_true(m == NULL || key == NULL, NULL);
+
+    len = strlen(key);
+    known = irc_tag_key(key, len);
+    if (known != irc_tag_key_unknown) {
+        return irc_message_tag_known(m, known);
+    }
+
+    if (IRC_FAILED(irc_message_tags_decode(m))) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < m->tagslen; i++) {
+        char const *k = m->tags[i]->key;
+
+        if (k[0] == key[0] && strcmp(k, key) == 0) {
+            return m->tags[i];
+        }
+    }
+
+    return NULL;
+}
+
+irc_message_t irc_message_parse_packed(char const *line, size_t len)
+{
+    irc_message_view_t v;
+
+    if (IRC_FAILED(irc_message_view_parse(&v, line, len))) {
+        return NULL;
+    }
+
+    return irc_message_view_promote(&v, 0);
+}
+
+static irc_message_t irc_message_make_pool(irc_pool_t pool,
+                                           char const *prefix,
+                                           char const *cmd, ...)
+{
+    va_list lst;
+    irc_message_t m = NULL;
+
+    va_start(lst, cmd);
+    m = irc_message_makev_pool(pool, prefix, cmd, lst);
+    va_end(lst);
+
+    return m;
+}
+
 irc_message_t irc_message_privmsg(char const *prefix, char const *target,
                                   char const *msg, ...)
 {
     va_list lst;
     irc_message_t m = NULL;
-    char *body = NULL;
+    char small[512];
+    char *body = small;
+    int len = 0;
 
+    /* almost every body fits a protocol line, only go to the heap for
+     * the ones that do not
+     */
     va_start(lst, msg);
-    vasprintf(&body, msg, lst);
+    len = vsnprintf(small, sizeof(small), msg, lst);
     va_end(lst);
 
-    if (body == NULL) {
+    if (len < 0) {
         return NULL;
     }
 
-    m = irc_message_make(prefix, "PRIVMSG", target, body, NULL);
-    free(body);
+    if ((size_t)len >= sizeof(small)) {
+        va_start(lst, msg);
+        len = vasprintf(&body, msg, lst);
+        va_end(lst);
+
+        if (len < 0) {
+            return NULL;
+        }
+    }
+
+    m = irc_message_make_pool(NULL, prefix, "PRIVMSG", target, body, NULL);
+
+    if (body != small) {
+        free(body);
+    }
 
     return m;
 }
@@ -277,8 +1001,10 @@ irc_message_t irc_message_makev(char const *prefix,
 
     if (prefix) {
         m->prefix = strdup(prefix);
+        irc_message_prefix_split(&m->source, m->prefix);
     }
     m->command = strdup(cmd);
+    m->code = irc_command_code(cmd, strlen(cmd));
 
     while ((arg = va_arg(lst, char*)) != NULL) {
         char *dup = strdup(arg);
@@ -288,79 +1014,273 @@ irc_message_t irc_message_makev(char const *prefix,
     return m;
 }
 
-irc_error_t irc_message_string(irc_message_t m, char **s, size_t *slen)
+irc_message_t irc_message_makev_pool(irc_pool_t pool,
+                                     char const *prefix,
+                                     char const *cmd,
+                                     va_list lst)
 {
-    strbuf_t buf = NULL;
-    char **tmp = NULL;
+    irc_message_view_t v;
+    va_list cpy;
+    char *arg = NULL;
 
-    if (m == NULL || s == NULL || slen == NULL) {
-        return irc_error_argument;
+    return_if_true(cmd == NULL, NULL);
+
+    memset(&v, 0, sizeof(v));
+
+    if (prefix != NULL) {
+        v.prefix.ptr = prefix;
+        v.prefix.len = strlen(prefix);
     }
+    v.command.ptr = cmd;
+    v.command.len = strlen(cmd);
+    v.code = irc_command_code(cmd, v.command.len);
 
-    if (m->command == NULL) {
-        return irc_error_protocol;
+    /* anything the view cannot hold takes the old road
+     */
+    va_copy(cpy, lst);
+    while ((arg = va_arg(cpy, char*)) != NULL) {
+        if (v.argslen == IRC_MESSAGE_MAXARGS) {
+            va_end(cpy);
+            return irc_message_makev(prefix, cmd, lst);
+        }
+        v.args[v.argslen].ptr = arg;
+        v.args[v.argslen].len = strlen(arg);
+        ++v.argslen;
     }
+    va_end(cpy);
 
-    buf = strbuf_new();
-    if (buf == NULL) {
-        return irc_error_memory;
+    return irc_message_view_promote_pool(&v, 0, pool);
+}
+
+static size_t irc_message_put(char *dst, size_t off,
+                              char const *s, size_t len)
+{
+    if (dst != NULL) {
+        memcpy(dst + off, s, len);
+    }
+    return off + len;
+}
+
+/* Decoded tags are the caller's to fill in, and a tag without a key has no
+ * wire form.
+ */
+static bool irc_message_tags_valid(irc_message_t m)
+{
+    return_if_true(irc_message_tags_pending(m), true);
+
+    for (size_t i = 0; i < m->tagslen; i++) {
+        if (m->tags[i] == NULL || m->tags[i]->key == NULL) {
+            return false;
+        }
     }
 
-    if (m->tagslen > 0) {
-        strbuf_append(buf, "@", 1);
+    return true;
+}
+
+/* Lays out the wire form of m in dst, or with dst being NULL only works out
+ * how long it is. Both passes walk the message the same way, so the length
+ * is always exact.
+ */
+static size_t irc_message_emit(irc_message_t m, char *dst)
+{
+    size_t off = 0;
+
+    if (irc_message_tags_pending(m)) {
+        /* tags that were never decoded are still escaped
+         */
+        off = irc_message_put(dst, off, "@", 1);
+        off = irc_message_put(dst, off, m->rawtags.ptr, m->rawtags.len);
+        off = irc_message_put(dst, off, " ", 1);
+    } else if (m->tagslen > 0) {
+        off = irc_message_put(dst, off, "@", 1);
         for (size_t i = 0; i < m->tagslen; i++) {
-            irc_error_t error = irc_error_internal;
-            char *str = NULL;
-            size_t len = 0;
-
-            error = irc_tag_string(m->tags[i], &str, &len);
-            if (IRC_FAILED(error)) {
-                strbuf_free(buf);
-                free(str);
-                return error;
-            } else {
-                strbuf_append(buf, str, len);
-            }
-            free(str);
+            irc_tag_t t = m->tags[i];
 
-            if (i + 1 < m->tagslen)
-                strbuf_append(buf, ";", 1);
+            off = irc_message_put(dst, off, t->key, strlen(t->key));
+            if (t->value != NULL) {
+                off = irc_message_put(dst, off, "=", 1);
+                off += irc_tag_escape_into(dst ? dst + off : NULL, t->value);
+            }
+            if (i + 1 < m->tagslen) {
+                off = irc_message_put(dst, off, ";", 1);
+            }
         }
-        strbuf_append(buf, " ", 1);
+        off = irc_message_put(dst, off, " ", 1);
     }
 
     if (m->prefix) {
-        strbuf_append(buf, ":", 1);
-        strbuf_append(buf, m->prefix, strlen(m->prefix));
-        strbuf_append(buf, " ", 1);
+        off = irc_message_put(dst, off, ":", 1);
+        off = irc_message_put(dst, off, m->prefix, strlen(m->prefix));
+        off = irc_message_put(dst, off, " ", 1);
     }
 
-    strbuf_append(buf, m->command, strlen(m->command));
-    strbuf_append(buf, " ", 1);
+    off = irc_message_put(dst, off, m->command, strlen(m->command));
+    off = irc_message_put(dst, off, " ", 1);
 
-    if (m->args) {
-        for (tmp = m->args; *tmp != NULL; ++tmp) {
-            size_t tmplen = strlen(*tmp);
-            /* if we find a space or argument starts with `:` we add a `:`
-             */
-            if (strchr(*tmp, ' ') != NULL || *tmp[0] == ':') {
-                strbuf_append(buf, ":", 1);
-            }
-            strbuf_append(buf, *tmp, tmplen);
+    for (size_t i = 0; m->args != NULL && m->args[i] != NULL; i++) {
+        char const *arg = m->args[i];
+        size_t len = strlen(arg);
+
+        /* if we find a space or argument starts with `:` we add a `:`
+         */
+        if (arg[0] == ':' || memchr(arg, ' ', len) != NULL) {
+            off = irc_message_put(dst, off, ":", 1);
+        }
+        off = irc_message_put(dst, off, arg, len);
+
+        if (m->args[i + 1] != NULL) {
+            off = irc_message_put(dst, off, " ", 1);
+        }
+    }
+
+    off = irc_message_put(dst, off, "\r\n", 2);
+
+    return off;
+}
+
+static void irc_message_iov_put(struct iovec *iov, int cap, int *cnt,
+                                char const *s, size_t len)
+{
+    if (len == 0) {
+        return;
+    }
+    if (*cnt < cap) {
+        iov[*cnt].iov_base = (void *)s;
+        iov[*cnt].iov_len = len;
+    }
+    ++(*cnt);
+}
+
+/* Escaped tag values are emitted as the runs between characters that need
+ * escaping, with the escape sequences themselves from static storage.
+ */
+static void irc_message_iov_value(struct iovec *iov, int cap, int *cnt,
+                                  char const *value)
+{
+    static char const *escapes = "\\:\\s\\\\\\r\\n";
+    static char const *special = "; \\\r\n";
+
+    while (*value != '\0') {
+        size_t run = strcspn(value, special);
+
+        irc_message_iov_put(iov, cap, cnt, value, run);
+        value += run;
+
+        if (*value != '\0') {
+            size_t idx = strchr(special, *value) - special;
 
-            if (tmp[1] != NULL) {
-                strbuf_append(buf, " ", 1);
+            irc_message_iov_put(iov, cap, cnt, escapes + 2 * idx, 2);
+            ++value;
+        }
+    }
+}
+
+irc_error_t irc_message_serialize_iov(irc_message_t m, struct iovec *iov,
+                                      int *n)
+{
+    int cap = 0;
+    int cnt = 0;
+
+    return_if_true(m == NULL || n == NULL, irc_error_argument);
+    return_if_true(iov == NULL && *n > 0, irc_error_argument);
+    return_if_true(m->command == NULL, irc_error_protocol);
+    return_if_true(!irc_message_tags_valid(m), irc_error_argument);
+
+    cap = *n;
+
+    if (irc_message_tags_pending(m)) {
+        irc_message_iov_put(iov, cap, &cnt, "@", 1);
+        irc_message_iov_put(iov, cap, &cnt, m->rawtags.ptr, m->rawtags.len);
+        irc_message_iov_put(iov, cap, &cnt, " ", 1);
+    } else if (m->tagslen > 0) {
+        for (size_t i = 0; i < m->tagslen; i++) {
+            irc_tag_t t = m->tags[i];
+
+            irc_message_iov_put(iov, cap, &cnt, (i == 0 ? "@" : ";"), 1);
+            irc_message_iov_put(iov, cap, &cnt, t->key, strlen(t->key));
+            if (t->value != NULL) {
+                irc_message_iov_put(iov, cap, &cnt, "=", 1);
+                irc_message_iov_value(iov, cap, &cnt, t->value);
             }
         }
+        irc_message_iov_put(iov, cap, &cnt, " ", 1);
+    }
+
+    if (m->prefix) {
+        irc_message_iov_put(iov, cap, &cnt, ":", 1);
+        irc_message_iov_put(iov, cap, &cnt, m->prefix, strlen(m->prefix));
+        irc_message_iov_put(iov, cap, &cnt, " ", 1);
+    }
+
+    irc_message_iov_put(iov, cap, &cnt, m->command, strlen(m->command));
+
+    for (size_t i = 0; m->args != NULL && m->args[i] != NULL; i++) {
+        char const *arg = m->args[i];
+        size_t len = strlen(arg);
+        bool colon = (arg[0] == ':' || memchr(arg, ' ', len) != NULL);
+
+        irc_message_iov_put(iov, cap, &cnt, (colon ? " :" : " "),
+                            (colon ? 2 : 1));
+        irc_message_iov_put(iov, cap, &cnt, arg, len);
+    }
+
+    if (m->args == NULL || m->args[0] == NULL) {
+        irc_message_iov_put(iov, cap, &cnt, " \r\n", 3);
+    } else {
+        irc_message_iov_put(iov, cap, &cnt, "\r\n", 2);
+    }
+
+    /* tell the caller how many entries it takes
+     */
+    *n = cnt;
+    return_if_true(cnt > cap, irc_error_argument);
+
+    return irc_error_success;
+}
+
+ssize_t irc_message_serialize_into(irc_message_t m, char *buf, size_t cap)
+{
+    size_t len = 0;
+
+    return_if_true(m == NULL || m->command == NULL, -1);
+    return_if_true(buf == NULL && cap > 0, -1);
+    return_if_true(!irc_message_tags_valid(m), -1);
+
+    len = irc_message_emit(m, NULL);
+    if (len <= cap) {
+        irc_message_emit(m, buf);
+    }
+
+    return len;
+}
+
+irc_error_t irc_message_string(irc_message_t m, char **s, size_t *slen)
+{
+    size_t len = 0;
+    char *str = NULL;
+
+    if (m == NULL || s == NULL || slen == NULL) {
+        return irc_error_argument;
+    }
+
+    if (m->command == NULL) {
+        return irc_error_protocol;
     }
 
-    strbuf_append(buf, "\r\n", 2);
+    if (!irc_message_tags_valid(m)) {
+        return irc_error_argument;
+    }
 
-    *s = strbuf_strdup(buf);
-    *slen = strlen(*s);
+    len = irc_message_emit(m, NULL);
+    str = malloc(len + 1);
+    if (str == NULL) {
+        return irc_error_memory;
+    }
+    irc_message_emit(m, str);
+    str[len] = '\0';
 
-    strbuf_free(buf);
-    buf = NULL;
+    *s = str;
+    *slen = len;
 
     return irc_error_success;
 }
@@ -371,6 +1291,12 @@ bool irc_message_is(irc_message_t m, char const *cmd)
     return (strcmp(m->command, cmd) == 0);
 }
 
+bool irc_message_is_code(irc_message_t m, irc_command_t code)
+{
+    return_if_true(m == NULL || code == irc_command_unknown, false);
+    return (m->code == code);
+}
+
 bool irc_message_arg_is(irc_message_t m, size_t idx, char const *what)
 {
     return_if_true(m == NULL, false);
@@ -378,22 +1304,71 @@ bool irc_message_arg_is(irc_message_t m, size_t idx, char const *what)
     return (strcmp(m->args[idx], what) == 0);
 }
 
-bool irc_message_prefix_nick(irc_message_t m, char const *nick)
+bool irc_message_arg_is_casemap(irc_message_t m, size_t idx,
+                                char const *what, irc_casemap_t cm)
 {
-    char *sep = NULL;
-    char *p = NULL;
+    return_if_true(m == NULL || what == NULL, false);
+    return_if_true(idx >= m->argslen, false);
+    return irc_casemap_equal(cm, m->args[idx], strlen(m->args[idx]),
+                             what, strlen(what));
+}
 
-    return_if_true(m == NULL || m->prefix == NULL, false);
+static irc_prefix_t irc_message_source(irc_message_t m)
+{
+    irc_prefix_t s;
 
-    p = m->prefix;
-    while (*p == ':' && *p != '\0') {
-        ++p;
+    /* a packed message's prefix lives in its own block, so a different
+     * pointer reliably means it was replaced. Other prefixes may have been
+     * freed and replaced by one at the very same address, those are split
+     * anew every time.
+     */
+    if ((m->flags & irc_message_flag_packed) && m->source.of == m->prefix) {
+        return m->source;
     }
 
-    sep = strchr(p, '!');
-    if (sep != NULL) {
-        return strncmp(p, nick, (sep - p)) == 0;
-    }
+    irc_message_prefix_split(&s, m->prefix);
+    return s;
+}
+
+irc_slice_t irc_message_prefix_nick_view(irc_message_t m)
+{
+    irc_slice_t none = {NULL, 0};
+
+    return_if_true(m == NULL || m->prefix == NULL, none);
+    return irc_message_source(m).nick;
+}
+
+irc_slice_t irc_message_prefix_user_view(irc_message_t m)
+{
+    irc_slice_t none = {NULL, 0};
+
+    return_if_true(m == NULL || m->prefix == NULL, none);
+    return irc_message_source(m).user;
+}
+
+irc_slice_t irc_message_prefix_host_view(irc_message_t m)
+{
+    irc_slice_t none = {NULL, 0};
+
+    return_if_true(m == NULL || m->prefix == NULL, none);
+    return irc_message_source(m).host;
+}
+
+bool irc_message_prefix_nick(irc_message_t m, char const *nick)
+{
+    irc_slice_t s = irc_message_prefix_nick_view(m);
+
+    return_if_true(s.ptr == NULL || nick == NULL, false);
+
+    return (strncmp(s.ptr, nick, s.len) == 0 && nick[s.len] == '\0');
+}
+
+bool irc_message_prefix_nick_casemap(irc_message_t m, char const *nick,
+                                     irc_casemap_t cm)
+{
+    irc_slice_t s = irc_message_prefix_nick_view(m);
+
+    return_if_true(s.ptr == NULL || nick == NULL, false);
 
-    return (strcmp(p, nick) == 0);
+    return irc_casemap_equal(cm, s.ptr, s.len, nick, strlen(nick));
 }
@@ -0,0 +1,212 @@
+#include <irc/pool.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+/* Blocks come in a few size classes, anything larger is allocated and
+ * freed directly. Every block carries a header in front of it that points
+ * back to its pool, so it can be released without knowing where it came
+ * from.
+ */
+#define IRC_POOL_CLASSES   6
+#define IRC_POOL_MINSHIFT  7
+#define IRC_POOL_NOCLASS   IRC_POOL_CLASSES
+
+typedef union irc_pool_block_
+{
+    struct {
+        irc_pool_t pool;
+        size_t cls;
+        union irc_pool_block_ *next;
+    } h;
+    max_align_t align;
+} irc_pool_block_t;
+
+struct irc_pool_
+{
+    pthread_mutex_t mtx;
+
+    irc_pool_block_t *free[IRC_POOL_CLASSES];
+    size_t freelen[IRC_POOL_CLASSES];
+    size_t cap;
+
+    /* the pool itself goes away once it has been freed, and the last
+     * block that is still out there has come back.
+     */
+    bool dead;
+    irc_pool_stats_t stats;
+};
+
+static size_t irc_pool_class(size_t size)
+{
+    size_t cls = 0;
+
+    while (cls < IRC_POOL_CLASSES &&
+           ((size_t)1 << (cls + IRC_POOL_MINSHIFT)) < size) {
+        ++cls;
+    }
+
+    return cls;
+}
+
+irc_pool_t irc_pool_new(size_t cap)
+{
+    irc_pool_t p = NULL;
+
+    p = calloc(1, sizeof(struct irc_pool_));
+    if (p == NULL) {
+        return NULL;
+    }
+
+    pthread_mutex_init(&p->mtx, NULL);
+    p->cap = cap;
+
+    return p;
+}
+
+static void irc_pool_trim(irc_pool_t p, size_t cap)
+{
+    for (size_t cls = 0; cls < IRC_POOL_CLASSES; cls++) {
+        while (p->freelen[cls] > cap) {
+            irc_pool_block_t *b = p->free[cls];
+
+            p->free[cls] = b->h.next;
+            --p->freelen[cls];
+            --p->stats.cached;
+            free(b);
+        }
+    }
+}
+
+static void irc_pool_destroy(irc_pool_t p)
+{
+    pthread_mutex_unlock(&p->mtx);
+    pthread_mutex_destroy(&p->mtx);
+    free(p);
+}
+
+void irc_pool_free(irc_pool_t p)
+{
+    return_if_true(p == NULL,);
+
+    pthread_mutex_lock(&p->mtx);
+    irc_pool_trim(p, 0);
+    p->dead = true;
+
+    if (p->stats.used > 0) {
+        pthread_mutex_unlock(&p->mtx);
+        return;
+    }
+
+    irc_pool_destroy(p);
+}
+
+void irc_pool_set_cap(irc_pool_t p, size_t cap)
+{
+    return_if_true(p == NULL,);
+
+    pthread_mutex_lock(&p->mtx);
+    p->cap = cap;
+    irc_pool_trim(p, cap);
+    pthread_mutex_unlock(&p->mtx);
+}
+
+irc_error_t irc_pool_stats(irc_pool_t p, irc_pool_stats_t *stats)
+{
+    return_if_true(p == NULL || stats == NULL, irc_error_argument);
+
+    pthread_mutex_lock(&p->mtx);
+    *stats = p->stats;
+    pthread_mutex_unlock(&p->mtx);
+
+    return irc_error_success;
+}
+
+void *irc_pool_alloc(irc_pool_t p, size_t size)
+{
+    irc_pool_block_t *b = NULL;
+    size_t cls = irc_pool_class(size);
+
+    if (p == NULL) {
+        return malloc(size);
+    }
+
+    pthread_mutex_lock(&p->mtx);
+    if (cls != IRC_POOL_NOCLASS && p->free[cls] != NULL) {
+        b = p->free[cls];
+        p->free[cls] = b->h.next;
+        --p->freelen[cls];
+        --p->stats.cached;
+        ++p->stats.hits;
+    } else {
+        ++p->stats.misses;
+    }
+    ++p->stats.used;
+    pthread_mutex_unlock(&p->mtx);
+
+    if (b == NULL) {
+        size_t room = size;
+
+        if (cls != IRC_POOL_NOCLASS) {
+            room = (size_t)1 << (cls + IRC_POOL_MINSHIFT);
+        }
+
+        b = malloc(sizeof(irc_pool_block_t) + room);
+        if (b == NULL) {
+            pthread_mutex_lock(&p->mtx);
+            --p->stats.used;
+            pthread_mutex_unlock(&p->mtx);
+            return NULL;
+        }
+        b->h.pool = p;
+        b->h.cls = cls;
+    }
+
+    b->h.next = NULL;
+
+    return b + 1;
+}
+
+irc_pool_t irc_pool_owner(void *ptr)
+{
+    return_if_true(ptr == NULL, NULL);
+    return ((irc_pool_block_t *)ptr - 1)->h.pool;
+}
+
+void irc_pool_release(void *ptr)
+{
+    irc_pool_block_t *b = NULL;
+    irc_pool_t p = NULL;
+    size_t cls = 0;
+
+    return_if_true(ptr == NULL,);
+
+    b = (irc_pool_block_t *)ptr - 1;
+    p = b->h.pool;
+    cls = b->h.cls;
+
+    pthread_mutex_lock(&p->mtx);
+    --p->stats.used;
+
+    if (!p->dead && cls != IRC_POOL_NOCLASS && p->freelen[cls] < p->cap) {
+        b->h.next = p->free[cls];
+        p->free[cls] = b;
+        ++p->freelen[cls];
+        ++p->stats.cached;
+        ++p->stats.recycled;
+        b = NULL;
+    } else {
+        ++p->stats.dropped;
+    }
+
+    if (p->dead && p->stats.used == 0) {
+        irc_pool_destroy(p);
+    } else {
+        pthread_mutex_unlock(&p->mtx);
+    }
+
+    free(b);
+}
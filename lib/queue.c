@@ -1,20 +1,19 @@
 #include <irc/queue.h>
 
 #include <stdlib.h>
+#include <string.h>
 
-struct irc_queue_item
-{
-    void *data;
-    struct irc_queue_item *next;
-    struct irc_queue_item *prev;
-};
-
-typedef struct irc_queue_item *irc_queue_item_t;
+/* A ring of pointers whose size is always a power of two, so wrapping
+ * around is a mask. Items are taken in the order they were pushed.
+ */
+#define IRC_QUEUE_MINSIZE  16
 
 struct irc_queue
 {
-    irc_queue_item_t head;
-    irc_queue_item_t tail;
+    void **items;
+    size_t size;
+    size_t head;
+    size_t len;
 };
 
 irc_queue_t irc_queue_new(void)
@@ -31,73 +30,106 @@ irc_queue_t irc_queue_new(void)
 
 void irc_queue_free(irc_queue_t q)
 {
-    irc_queue_item_t it;
-
     if (!q) {
         return;
     }
 
-    it = q->head;
-    while (it != NULL) {
-        irc_queue_item_t nx = it->next;
-        free(it);
-        it = nx;
+    free(q->items);
+    free(q);
+}
+
+static irc_error_t irc_queue_grow(irc_queue_t q)
+{
+    size_t size = (q->size > 0 ? q->size * 2 : IRC_QUEUE_MINSIZE);
+    void **items = NULL;
+    size_t first = 0;
+
+    items = realloc(q->items, size * sizeof(void*));
+    return_if_true(items == NULL, irc_error_memory);
+
+    /* the part that wrapped around to the front goes right after the
+     * old end, where the ring continues now
+     */
+    first = q->size - q->head;
+    if (q->len > first) {
+        memcpy(items + q->size, items, (q->len - first) * sizeof(void*));
     }
 
-    free(q);
+    q->items = items;
+    q->size = size;
+
+    return irc_error_success;
 }
 
 irc_error_t irc_queue_push(irc_queue_t q, void *what)
 {
-    irc_queue_item_t ny = NULL;
-
     return_if_true(q == NULL, irc_error_argument);
 
-    ny = calloc(1, sizeof(struct irc_queue_item));
-    return_if_true(ny == NULL, irc_error_memory);
-    ny->data = what;
-
-    if (q->head == NULL) {
-        q->head = q->tail = ny;
-    } else {
-        ny->prev = q->tail;
-        q->tail->next = ny;
-        q->tail = ny;
+    if (q->len == q->size) {
+        irc_error_t r = irc_queue_grow(q);
+        return_if_true(IRC_FAILED(r), r);
     }
 
+    q->items[(q->head + q->len) & (q->size - 1)] = what;
+    ++q->len;
+
     return irc_error_success;
 }
 
 void *irc_queue_pop(irc_queue_t q)
 {
-    irc_queue_item_t it = NULL, prev = NULL;
     void *data = NULL;
 
     return_if_true(q == NULL, NULL);
-    return_if_true(q->head == NULL, NULL);
-    return_if_true(q->tail == NULL, NULL);
+    return_if_true(q->len == 0, NULL);
 
-    it = q->tail;
-    prev = it->prev;
+    data = q->items[q->head];
+    q->head = (q->head + 1) & (q->size - 1);
+    --q->len;
 
-    if (prev) {
-        prev->next = NULL;
-        q->tail = prev;
-    } else {
-        q->head = q->tail = NULL;
+    return data;
+}
+
+size_t irc_queue_pop_n(irc_queue_t q, void **out, size_t n)
+{
+    size_t first = 0;
+
+    return_if_true(q == NULL || out == NULL, 0);
+
+    if (n > q->len) {
+        n = q->len;
+    }
+
+    /* at most two runs, up to the end of the ring and from its start
+     */
+    first = q->size - q->head;
+    if (first > n) {
+        first = n;
     }
+    memcpy(out, q->items + q->head, first * sizeof(void*));
+    memcpy(out + first, q->items, (n - first) * sizeof(void*));
 
-    data = it->data;
-    free(it);
+    if (n > 0) {
+        q->head = (q->head + n) & (q->size - 1);
+        q->len -= n;
+    }
 
-    return data;
+    return n;
+}
+
+size_t irc_queue_len(irc_queue_t q)
+{
+    return_if_true(q == NULL, 0);
+    return q->len;
 }
 
 void irc_queue_clear(irc_queue_t q, free_t ff)
 {
-    void *p = NULL;
+    return_if_true(q == NULL,);
+
+    while (q->len > 0) {
+        void *p = irc_queue_pop(q);
 
-    while ((p = irc_queue_pop(q)) != NULL) {
         if (ff != NULL) {
             ff(p);
         }
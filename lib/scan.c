@@ -0,0 +1,201 @@
+#include "scan.h"
+
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define IRC_SCAN_X86
+#include <immintrin.h>
+#endif
+
+typedef char const *(*irc_scan_crlf_t)(char const *, size_t);
+typedef uint64_t (*irc_scan_mask_t)(char const *, char);
+
+static char const *irc_scan_crlf_scalar(char const *buf, size_t len)
+{
+    char const *end = buf + len;
+    char const *p = buf;
+
+    while ((p = memchr(p, '\r', end - p)) != NULL) {
+        if (p + 1 >= end) {
+            break;
+        }
+        if (p[1] == '\n') {
+            return p;
+        }
+        ++p;
+    }
+
+    return NULL;
+}
+
+/* Returns a mask with a bit set for every byte of the 64 byte block at p
+ * that equals c.
+ */
+static uint64_t irc_scan_mask_scalar(char const *p, char c)
+{
+    uint64_t mask = 0;
+
+    for (size_t i = 0; i < 64; i++) {
+        mask |= (uint64_t)(p[i] == c) << i;
+    }
+
+    return mask;
+}
+
+#ifdef IRC_SCAN_X86
+__attribute__((target("sse2")))
+static uint64_t irc_scan_mask_sse2(char const *p, char c)
+{
+    __m128i const v = _mm_set1_epi8(c);
+    uint64_t mask = 0;
+
+    for (size_t i = 0; i < 4; i++) {
+        __m128i a = _mm_loadu_si128((__m128i const *)(p + (i * 16)));
+
+        mask |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(a, v))
+            << (i * 16);
+    }
+
+    return mask;
+}
+
+__attribute__((target("avx2")))
+static uint64_t irc_scan_mask_avx2(char const *p, char c)
+{
+    __m256i const v = _mm256_set1_epi8(c);
+    __m256i lo = _mm256_loadu_si256((__m256i const *)p);
+    __m256i hi = _mm256_loadu_si256((__m256i const *)(p + 32));
+
+    return (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, v)) |
+        ((uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, v))
+         << 32);
+}
+
+/* Both variants compare a block against '\r' and the same block shifted by
+ * one byte against '\n', so a set bit in the combined mask marks the start
+ * of a "\r\n" pair. The final, partial block is handed to the scalar code.
+ */
+__attribute__((target("sse2")))
+static char const *irc_scan_crlf_sse2(char const *buf, size_t len)
+{
+    char const *p = buf;
+    char const *end = buf + len;
+    __m128i const cr = _mm_set1_epi8('\r');
+    __m128i const lf = _mm_set1_epi8('\n');
+
+    while (end - p > 16) {
+        __m128i a = _mm_loadu_si128((__m128i const *)p);
+        __m128i b = _mm_loadu_si128((__m128i const *)(p + 1));
+        unsigned mask = _mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(a, cr), _mm_cmpeq_epi8(b, lf))
+            );
+
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+
+    return irc_scan_crlf_scalar(p, end - p);
+}
+
+__attribute__((target("avx2")))
+static char const *irc_scan_crlf_avx2(char const *buf, size_t len)
+{
+    char const *p = buf;
+    char const *end = buf + len;
+    __m256i const cr = _mm256_set1_epi8('\r');
+    __m256i const lf = _mm256_set1_epi8('\n');
+
+    while (end - p > 32) {
+        __m256i a = _mm256_loadu_si256((__m256i const *)p);
+        __m256i b = _mm256_loadu_si256((__m256i const *)(p + 1));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(a, cr),
+                             _mm256_cmpeq_epi8(b, lf))
+            );
+
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+
+    return irc_scan_crlf_sse2(p, end - p);
+}
+#endif
+
+static irc_scan_crlf_t scan_crlf = irc_scan_crlf_scalar;
+static irc_scan_mask_t scan_mask = irc_scan_mask_scalar;
+static pthread_once_t scan_once = PTHREAD_ONCE_INIT;
+
+static void irc_scan_init(void)
+{
+#ifdef IRC_SCAN_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2")) {
+        scan_crlf = irc_scan_crlf_avx2;
+        scan_mask = irc_scan_mask_avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        scan_crlf = irc_scan_crlf_sse2;
+        scan_mask = irc_scan_mask_sse2;
+    }
+#endif
+}
+
+char const *irc_scan_crlf(char const *buf, size_t len)
+{
+    pthread_once(&scan_once, irc_scan_init);
+    return scan_crlf(buf, len);
+}
+
+static uint64_t irc_scan_block(irc_scan_t *s)
+{
+    char const *p = s->buf + s->base;
+    size_t left = s->len - s->base;
+    uint64_t mask = 0;
+
+    if (left >= 64) {
+        return scan_mask(p, ' ');
+    }
+
+    /* never read past the end of the buffer
+     */
+    for (size_t i = 0; i < left; i++) {
+        mask |= (uint64_t)(p[i] == ' ') << i;
+    }
+
+    return mask;
+}
+
+void irc_scan_spaces(irc_scan_t *s, char const *buf, size_t len)
+{
+    pthread_once(&scan_once, irc_scan_init);
+
+    s->buf = buf;
+    s->len = len;
+    s->base = 0;
+    s->mask = (len > 0 ? irc_scan_block(s) : 0);
+}
+
+size_t irc_scan_next(irc_scan_t *s)
+{
+    size_t pos = 0;
+
+    while (s->mask == 0) {
+        if (s->len - s->base <= 64) {
+            s->base = s->len;
+            return s->len;
+        }
+        s->base += 64;
+        s->mask = irc_scan_block(s);
+    }
+
+    pos = s->base + __builtin_ctzll(s->mask);
+    s->mask &= s->mask - 1;
+
+    return pos;
+}
@@ -0,0 +1,28 @@
+#ifndef LIBIRC_SCAN_H
+#define LIBIRC_SCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Returns a pointer to the first "\r\n" within the first len bytes of buf,
+ * or NULL if there is none. The buffer need not be NUL terminated.
+ */
+char const *irc_scan_crlf(char const *buf, size_t len);
+
+/* Iterates over the spaces in a buffer, a block of 64 bytes at a time,
+ * through a bitmask per block.
+ */
+typedef struct {
+    char const *buf;
+    size_t len;
+    size_t base;
+    uint64_t mask;
+} irc_scan_t;
+
+void irc_scan_spaces(irc_scan_t *s, char const *buf, size_t len);
+
+/* Returns the offset of the next space, or len if there are no more.
+ */
+size_t irc_scan_next(irc_scan_t *s);
+
+#endif
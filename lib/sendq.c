@@ -0,0 +1,402 @@
+#include "sendq.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#ifdef HAVE_EVENTFD
+#include <sys/eventfd.h>
+#endif
+
+/* A bounded ring after Dmitry Vyukov's MPMC queue, where each cell's
+ * sequence number tells whether it is free for the producer at that
+ * position, or holds an item for the consumer. Only one consumer ever
+ * pops, so the head needs no atomics.
+ *
+ * Should the ring ever fill up, pushes go to a locked overflow queue
+ * until the consumer has emptied it again, so nothing is lost and every
+ * producer's items still leave in the order they were pushed.
+ */
+#define IRC_SENDQ_MINSIZE  64
+
+typedef struct {
+    atomic_size_t seq;
+    void *data;
+} irc_sendq_cell_t;
+
+typedef struct
+{
+    irc_sendq_cell_t *cells;
+    size_t mask;
+
+    _Alignas(64) atomic_size_t tail;
+    _Alignas(64) size_t head;
+
+    atomic_bool overflowing;
+    pthread_mutex_t overflowmtx;
+    irc_queue_t overflow;
+} irc_sendq_lane_t;
+
+struct irc_sendq_
+{
+    irc_sendq_lane_t *lanes;
+    size_t laneslen;
+
+    /* set by the consumer before it goes to sleep, shared by all lanes
+     */
+    atomic_bool armed;
+    int fd;
+
+    /* the write end of the pipe, or the same eventfd
+     */
+    int wakefd;
+};
+
+static irc_error_t irc_sendq_lane_init(irc_sendq_lane_t *l, size_t cells)
+{
+    l->cells = calloc(cells, sizeof(irc_sendq_cell_t));
+    l->overflow = irc_queue_new();
+    if (l->cells == NULL || l->overflow == NULL) {
+        return irc_error_memory;
+    }
+
+    for (size_t i = 0; i < cells; i++) {
+        atomic_init(&l->cells[i].seq, i);
+    }
+    l->mask = cells - 1;
+
+    atomic_init(&l->tail, 0);
+    atomic_init(&l->overflowing, false);
+    pthread_mutex_init(&l->overflowmtx, NULL);
+
+    return irc_error_success;
+}
+
+#ifdef HAVE_EVENTFD
+static irc_error_t irc_sendq_fd_open(irc_sendq_t q)
+{
+    q->fd = q->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    return (q->fd < 0 ? irc_error_io : irc_error_success);
+}
+
+static void irc_sendq_fd_signal(irc_sendq_t q)
+{
+    uint64_t one = 1;
+    (void)!write(q->wakefd, &one, sizeof(one));
+}
+
+static void irc_sendq_fd_drain(irc_sendq_t q)
+{
+    uint64_t count = 0;
+    (void)!read(q->fd, &count, sizeof(count));
+}
+#else
+static irc_error_t irc_sendq_fd_open(irc_sendq_t q)
+{
+    int fds[2] = {-1, -1};
+
+    return_if_true(pipe(fds) < 0, irc_error_io);
+    q->fd = fds[0];
+    q->wakefd = fds[1];
+
+    for (int k = 0; k < 2; k++) {
+        if (fcntl(fds[k], F_SETFL, fcntl(fds[k], F_GETFL) | O_NONBLOCK) < 0 ||
+            fcntl(fds[k], F_SETFD, FD_CLOEXEC) < 0) {
+            return irc_error_io;
+        }
+    }
+
+    return irc_error_success;
+}
+
+static void irc_sendq_fd_signal(irc_sendq_t q)
+{
+    char one = 1;
+
+    /* a full pipe is readable already
+     */
+    (void)!write(q->wakefd, &one, sizeof(one));
+}
+
+static void irc_sendq_fd_drain(irc_sendq_t q)
+{
+    char buf[64];
+
+    while (read(q->fd, buf, sizeof(buf)) == sizeof(buf))
+        ;
+}
+#endif
+
+irc_sendq_t irc_sendq_new(size_t size, size_t lanes)
+{
+    irc_sendq_t q = NULL;
+    size_t cells = IRC_SENDQ_MINSIZE;
+
+    return_if_true(lanes == 0, NULL);
+
+    while (cells < size) {
+        cells <<= 1;
+    }
+
+    q = calloc(1, sizeof(struct irc_sendq_));
+    if (q == NULL) {
+        return NULL;
+    }
+
+    q->fd = q->wakefd = -1;
+
+    q->lanes = aligned_alloc(_Alignof(irc_sendq_lane_t),
+                             lanes * sizeof(irc_sendq_lane_t));
+    if (q->lanes == NULL) {
+        irc_sendq_free(q, NULL);
+        return NULL;
+    }
+    memset(q->lanes, 0, lanes * sizeof(irc_sendq_lane_t));
+
+    for (; q->laneslen < lanes; q->laneslen++) {
+        if (IRC_FAILED(irc_sendq_lane_init(q->lanes + q->laneslen, cells))) {
+            /* counts the half set up lane too, free copes with that
+             */
+            ++q->laneslen;
+            irc_sendq_free(q, NULL);
+            return NULL;
+        }
+    }
+
+    if (IRC_FAILED(irc_sendq_fd_open(q))) {
+        irc_sendq_free(q, NULL);
+        return NULL;
+    }
+
+    /* start armed, an event loop may poll the fd before it ever pops
+     */
+    atomic_init(&q->armed, true);
+
+    return q;
+}
+
+void irc_sendq_free(irc_sendq_t q, free_t ff)
+{
+    return_if_true(q == NULL,);
+
+    for (size_t i = 0; i < q->laneslen; i++) {
+        irc_sendq_lane_t *l = q->lanes + i;
+
+        if (l->cells != NULL && l->overflow != NULL) {
+            irc_sendq_clear(q, i, ff);
+            pthread_mutex_destroy(&l->overflowmtx);
+        }
+        irc_queue_free(l->overflow);
+        free(l->cells);
+    }
+
+    if (q->wakefd >= 0 && q->wakefd != q->fd) {
+        close(q->wakefd);
+    }
+    if (q->fd >= 0) {
+        close(q->fd);
+    }
+    free(q->lanes);
+    free(q);
+}
+
+static void irc_sendq_wake(irc_sendq_t q)
+{
+    /* pairs with the fence in irc_sendq_arm(): either the consumer sees
+     * our item, or we see it armed
+     */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (!atomic_load_explicit(&q->armed, memory_order_relaxed)) {
+        return;
+    }
+
+    if (atomic_exchange_explicit(&q->armed, false, memory_order_relaxed)) {
+        irc_sendq_fd_signal(q);
+    }
+}
+
+static bool irc_sendq_ring_push(irc_sendq_lane_t *l, void *what)
+{
+    size_t pos = atomic_load_explicit(&l->tail, memory_order_relaxed);
+    irc_sendq_cell_t *cell = NULL;
+
+    for (;;) {
+        size_t seq = 0;
+        intptr_t dif = 0;
+
+        cell = l->cells + (pos & l->mask);
+        seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        dif = (intptr_t)seq - (intptr_t)pos;
+
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(
+                    &l->tail, &pos, pos + 1,
+                    memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (dif < 0) {
+            /* full */
+            return false;
+        } else {
+            pos = atomic_load_explicit(&l->tail, memory_order_relaxed);
+        }
+    }
+
+    cell->data = what;
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+
+    return true;
+}
+
+irc_error_t irc_sendq_push(irc_sendq_t q, size_t lane, void *what)
+{
+    irc_error_t r = irc_error_success;
+    irc_sendq_lane_t *l = NULL;
+
+    return_if_true(q == NULL || what == NULL, irc_error_argument);
+    return_if_true(lane >= q->laneslen, irc_error_argument);
+
+    l = q->lanes + lane;
+
+    if (!atomic_load_explicit(&l->overflowing, memory_order_acquire) &&
+        irc_sendq_ring_push(l, what)) {
+        irc_sendq_wake(q);
+        return irc_error_success;
+    }
+
+    pthread_mutex_lock(&l->overflowmtx);
+    atomic_store_explicit(&l->overflowing, true, memory_order_release);
+    r = irc_queue_push(l->overflow, what);
+    pthread_mutex_unlock(&l->overflowmtx);
+
+    irc_sendq_wake(q);
+
+    return r;
+}
+
+static void *irc_sendq_ring_pop(irc_sendq_lane_t *l)
+{
+    irc_sendq_cell_t *cell = l->cells + (l->head & l->mask);
+    size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+    void *data = NULL;
+
+    if (seq != l->head + 1) {
+        return NULL;
+    }
+
+    data = cell->data;
+    atomic_store_explicit(&cell->seq, l->head + l->mask + 1,
+                          memory_order_release);
+    ++l->head;
+
+    return data;
+}
+
+/* no cell is claimed by a producer that has yet to fill it in
+ */
+static bool irc_sendq_ring_empty(irc_sendq_lane_t *l)
+{
+    return (atomic_load_explicit(&l->tail, memory_order_acquire) == l->head);
+}
+
+static void *irc_sendq_take(irc_sendq_lane_t *l)
+{
+    void *data = irc_sendq_ring_pop(l);
+
+    if (data != NULL ||
+        !atomic_load_explicit(&l->overflowing, memory_order_acquire)) {
+        return data;
+    }
+
+    /* the ring is drained, whatever went past it comes next. A cell that
+     * is claimed but not yet filled in may hold an item pushed before some
+     * of the overflow, so that has to wait until it is.
+     */
+    pthread_mutex_lock(&l->overflowmtx);
+    data = irc_sendq_ring_pop(l);
+    if (data == NULL && irc_sendq_ring_empty(l)) {
+        data = irc_queue_pop(l->overflow);
+        if (irc_queue_len(l->overflow) == 0) {
+            atomic_store_explicit(&l->overflowing, false,
+                                  memory_order_release);
+        }
+    }
+    pthread_mutex_unlock(&l->overflowmtx);
+
+    return data;
+}
+
+void *irc_sendq_pop(irc_sendq_t q, size_t lane)
+{
+    return_if_true(q == NULL || lane >= q->laneslen, NULL);
+    return irc_sendq_take(q->lanes + lane);
+}
+
+void *irc_sendq_peek(irc_sendq_t q, size_t lane, size_t nth)
+{
+    irc_sendq_lane_t *l = NULL;
+    irc_sendq_cell_t *cell = NULL;
+    size_t pos = 0;
+
+    return_if_true(q == NULL || lane >= q->laneslen, NULL);
+
+    /* only looks into the ring, whatever went to the overflow comes after
+     * it anyway. The consumer is the only one to take cells, so they stay
+     * put until it pops them.
+     */
+    l = q->lanes + lane;
+    return_if_true(nth > l->mask, NULL);
+
+    pos = l->head + nth;
+    cell = l->cells + (pos & l->mask);
+    if (atomic_load_explicit(&cell->seq, memory_order_acquire) != pos + 1) {
+        return NULL;
+    }
+
+    return cell->data;
+}
+
+void irc_sendq_quiet(irc_sendq_t q)
+{
+    return_if_true(q == NULL,);
+
+    /* reset the descriptor, but without asking producers to wake us
+     */
+    irc_sendq_fd_drain(q);
+}
+
+void irc_sendq_arm(irc_sendq_t q)
+{
+    return_if_true(q == NULL,);
+
+    /* going idle: reset the descriptor and ask producers to wake us.
+     * The caller must look once more for anything that came in meanwhile.
+     */
+    irc_sendq_fd_drain(q);
+    atomic_store_explicit(&q->armed, true, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+void irc_sendq_clear(irc_sendq_t q, size_t lane, free_t ff)
+{
+    void *p = NULL;
+
+    return_if_true(q == NULL || lane >= q->laneslen,);
+
+    while ((p = irc_sendq_take(q->lanes + lane)) != NULL) {
+        if (ff != NULL) {
+            ff(p);
+        }
+    }
+}
+
+int irc_sendq_fd(irc_sendq_t q)
+{
+    return_if_true(q == NULL, -1);
+    return q->fd;
+}
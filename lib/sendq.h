@@ -0,0 +1,32 @@
+#ifndef LIBIRC_SENDQ_H
+#define LIBIRC_SENDQ_H
+
+#include <irc/error.h>
+#include <irc/queue.h>
+
+#include <stddef.h>
+
+/* Many threads push, exactly one pops. Items go into one of several
+ * independent lanes, each of them FIFO, and the consumer decides which lane
+ * it pops from next. Once it found all of them empty it calls
+ * irc_sendq_arm(), checks again, and is then woken up through a file
+ * descriptor. The consumer may also look ahead into a lane with
+ * irc_sendq_peek() without taking anything, and silence the descriptor
+ * with irc_sendq_quiet() while it can not send anyway.
+ */
+struct irc_sendq_;
+typedef struct irc_sendq_ *irc_sendq_t;
+
+irc_sendq_t irc_sendq_new(size_t size, size_t lanes);
+void irc_sendq_free(irc_sendq_t q, free_t ff);
+
+irc_error_t irc_sendq_push(irc_sendq_t q, size_t lane, void *what);
+void *irc_sendq_pop(irc_sendq_t q, size_t lane);
+void *irc_sendq_peek(irc_sendq_t q, size_t lane, size_t nth);
+void irc_sendq_arm(irc_sendq_t q);
+void irc_sendq_quiet(irc_sendq_t q);
+void irc_sendq_clear(irc_sendq_t q, size_t lane, free_t ff);
+
+int irc_sendq_fd(irc_sendq_t q);
+
+#endif
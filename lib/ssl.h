@@ -4,6 +4,7 @@
 #include <irc/error.h>
 #include <stdint.h>
 #include <unistd.h>
+#include <sys/uio.h>
 
 void *irc_ssl_client_new(void);
 void irc_ssl_client_free(void *arg);
@@ -11,5 +12,6 @@ irc_error_t irc_ssl_client_connect(void *arg, int sock, char const *host);
 irc_error_t irc_ssl_client_disconnect(void *arg);
 int irc_ssl_client_read(void *arg, void *buffer, size_t);
 int irc_ssl_client_write(void *arg, void const *buffer, size_t);
+int irc_ssl_client_writev(void *arg, struct iovec const *iov, int iovcnt);
 
 #endif
@@ -1,15 +1,28 @@
 #define _GNU_SOURCE
 #include <irc/strbuf.h>
+#include "scan.h"
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <sys/types.h>
 
+#define STRBUF_MINSIZE 64
+
 struct strbuf_
 {
     char *buf;
     size_t bufsize;
+    size_t start;
     size_t end;
+    /* range in which we know that no "\r\n" starts
+     */
+    size_t scanstart;
+    size_t scanend;
+    /* shrink back to this size once drained, 0 to never shrink
+     */
+    size_t highwater;
 };
 
 strbuf_t strbuf_new(void)
@@ -31,7 +44,8 @@ void strbuf_free(strbuf_t b)
     }
 
     free(b->buf);
-    b->bufsize = b->end = 0;
+    b->bufsize = b->start = b->end = 0;
+    b->scanstart = b->scanend = 0;
 
     free(b);
 }
@@ -45,7 +59,134 @@ void strbuf_reset(strbuf_t b)
     free(b->buf);
     b->buf = NULL;
 
-    b->end = b->bufsize = 0;
+    b->start = b->end = b->bufsize = 0;
+    b->scanstart = b->scanend = 0;
+}
+
+/* Moves the known scan range along when the data is moved to the front.
+ */
+static void strbuf_rebase_scan(strbuf_t b)
+{
+    b->scanstart = (b->scanstart > b->start ? b->scanstart - b->start : 0);
+    b->scanend = (b->scanend > b->start ? b->scanend - b->start : 0);
+}
+
+/* Data lives between start and end. Consuming from the front only moves
+ * start forward, and the consumed head is reclaimed lazily here once it is
+ * at least as large as the remaining data, so every byte is moved at most
+ * a constant number of times.
+ */
+static void strbuf_compact(strbuf_t b)
+{
+    size_t len = b->end - b->start;
+
+    if (b->start == 0 || b->start < len) {
+        return;
+    }
+
+    memmove(b->buf, b->buf + b->start, len);
+
+    strbuf_rebase_scan(b);
+    b->start = 0;
+    b->end = len;
+}
+
+static void strbuf_consume(strbuf_t b, size_t how)
+{
+    b->start += how;
+
+    if (b->start == b->end) {
+        b->start = b->end = 0;
+        b->scanstart = b->scanend = 0;
+
+        if (b->highwater > 0 && b->bufsize > b->highwater) {
+            char *tmp = realloc(b->buf, b->highwater);
+
+            if (tmp != NULL) {
+                b->buf = tmp;
+                b->bufsize = b->highwater;
+            }
+        }
+    }
+}
+
+int strbuf_reserve(strbuf_t b, size_t len)
+{
+    size_t size = 0;
+    char *tmp = NULL;
+
+    if (b == NULL) {
+        return -1;
+    }
+
+    strbuf_compact(b);
+
+    if (len <= b->bufsize - b->end) {
+        return 0;
+    }
+
+    if (len > SIZE_MAX / 2 - b->end) {
+        return -2;
+    }
+
+    /* grow geometrically, so that appending byte by byte stays linear
+     */
+    size = (b->bufsize > 0 ? b->bufsize : STRBUF_MINSIZE);
+    while (size < b->end + len) {
+        size *= 2;
+    }
+
+    tmp = realloc(b->buf, size);
+    if (tmp == NULL) {
+        return -2;
+    }
+
+    b->buf = tmp;
+    b->bufsize = size;
+
+    return 0;
+}
+
+int strbuf_shrink(strbuf_t b)
+{
+    size_t len = 0;
+    char *tmp = NULL;
+
+    if (b == NULL) {
+        return -1;
+    }
+
+    len = b->end - b->start;
+    if (len == 0) {
+        strbuf_reset(b);
+        return 0;
+    }
+
+    if (b->start > 0) {
+        memmove(b->buf, b->buf + b->start, len);
+        strbuf_rebase_scan(b);
+        b->start = 0;
+        b->end = len;
+    }
+
+    tmp = realloc(b->buf, len);
+    if (tmp == NULL) {
+        return -2;
+    }
+
+    b->buf = tmp;
+    b->bufsize = len;
+
+    return 0;
+}
+
+void strbuf_set_highwater(strbuf_t b, size_t size)
+{
+    if (b == NULL) {
+        return;
+    }
+
+    b->highwater = size;
 }
 
 ssize_t strbuf_append(strbuf_t b, char const *buffer, ssize_t len)
@@ -58,26 +199,13 @@ ssize_t strbuf_append(strbuf_t b, char const *buffer, ssize_t len)
         len = strlen(buffer);
     }
 
-    if ((len+b->end) > b->bufsize) {
-        char *tmp = NULL;
-
-        tmp = reallocarray(b->buf, (b->bufsize+len+1), sizeof(char));
-        if (tmp == NULL) {
-            return -2;
-        }
-        memset(tmp + b->end, 0, len+1);
-
-        b->buf = tmp;
-        b->bufsize += len;
+    if (strbuf_reserve(b, len) < 0) {
+        return -2;
     }
 
     memcpy(b->buf + b->end, buffer, len);
     b->end += len;
 
-    if (b->end < b->bufsize) {
-        memset(b->buf+b->end, 0, b->bufsize - b->end);
-    }
-
     return len;
 }
 
@@ -92,29 +220,25 @@ ssize_t strbuf_getdelim(strbuf_t b, char **line, size_t *linesize, int delim)
     ssize_t diff = 0;
     char *l = NULL;
 
-    if (b->end == 0) {
+    if (b->end == b->start) {
         return -1;
     }
 
-    pos = memchr(b->buf, delim, b->end);
+    pos = memchr(b->buf + b->start, delim, b->end - b->start);
     if (pos == NULL) {
         /* not found, so entire string
          */
         pos = b->buf + b->end - 1;
     }
 
-    diff = (ssize_t)(pos - b->buf) + 1;
+    diff = (ssize_t)(pos - (b->buf + b->start)) + 1;
     l = calloc(diff + 1, sizeof(char));
     if (l == NULL) {
         return -2;
     }
 
-    memcpy(l, b->buf, diff);
-
-    memmove(b->buf, pos+1, b->end - diff);
-    b->end -= diff;
-
-    memset(b->buf + b->end, 0, b->bufsize - b->end);
+    memcpy(l, b->buf + b->start, diff);
+    strbuf_consume(b, diff);
 
     *line = l;
     *linesize = diff;
@@ -122,34 +246,107 @@ ssize_t strbuf_getdelim(strbuf_t b, char **line, size_t *linesize, int delim)
     return 0;
 }
 
-ssize_t strbuf_getstr(strbuf_t b, char **line, size_t *linesize,
-                      char const *small)
+/* Finds the next occurence of small at or after offset from.
+ */
+static char const *strbuf_find(strbuf_t b, size_t from, char const *small,
+                               size_t slen)
 {
-    char *pos = NULL;
-    size_t diff = 0;
-    size_t slen = strlen(small);
-    char *l = NULL;
+    char const *pos = NULL;
+    size_t scanstart = from;
+
+    if (from >= b->end) {
+        return NULL;
+    }
+
+    if (strcmp(small, "\r\n") == 0) {
+        /* resume where the last scan gave up, a partial line is never
+         * scanned twice. The last byte may be the \r of a pair though.
+         */
+        if (from >= b->scanstart && from <= b->scanend) {
+            scanstart = b->scanstart;
+            from = b->scanend;
+        }
+
+        pos = irc_scan_crlf(b->buf + from, b->end - from);
+        if (pos == NULL) {
+            b->scanstart = scanstart;
+            b->scanend = b->end - 1;
+        }
+    } else {
+        pos = memmem(b->buf + from, b->end - from, small, slen);
+    }
 
-    if (b->end == 0) {
+    return pos;
+}
+
+ssize_t strbuf_peekstr(strbuf_t b, char const **line, size_t *linesize,
+                       char const *small)
+{
+    char const *pos = NULL;
+    size_t slen = 0;
+
+    if (b == NULL || b->end == b->start) {
         return -1;
     }
 
-    pos = strstr(b->buf, small);
+    slen = strlen(small);
+
+    pos = strbuf_find(b, b->start, small, slen);
     if (pos == NULL) {
         return -1;
     }
 
-    diff = ((size_t)(pos - b->buf)) + slen;
+    *line = b->buf + b->start;
+    *linesize = ((size_t)(pos - (b->buf + b->start))) + slen;
+
+    return 0;
+}
+
+ssize_t strbuf_peekstrv(strbuf_t b, struct iovec *iov, size_t iovcnt,
+                        char const *small)
+{
+    char const *pos = NULL;
+    size_t from = 0;
+    size_t slen = 0;
+    size_t n = 0;
+
+    if (b == NULL || iov == NULL) {
+        return -1;
+    }
+
+    slen = strlen(small);
+    from = b->start;
+
+    while (n < iovcnt &&
+           (pos = strbuf_find(b, from, small, slen)) != NULL) {
+        iov[n].iov_base = b->buf + from;
+        iov[n].iov_len = ((size_t)(pos - (b->buf + from))) + slen;
+
+        from += iov[n].iov_len;
+        ++n;
+    }
+
+    return n;
+}
+
+ssize_t strbuf_getstr(strbuf_t b, char **line, size_t *linesize,
+                      char const *small)
+{
+    char const *pos = NULL;
+    size_t diff = 0;
+    char *l = NULL;
+
+    if (strbuf_peekstr(b, &pos, &diff, small) < 0) {
+        return -1;
+    }
+
     l = calloc(diff + 1, sizeof(char));
     if (l == NULL) {
         return -2;
     }
 
-    memcpy(l, b->buf, diff);
-
-    b->end -= diff;
-    memmove(b->buf, pos+slen, b->end);
-    memset(b->buf + b->end, 0, b->bufsize - b->end);
+    memcpy(l, pos, diff);
+    strbuf_consume(b, diff);
 
     *line = l;
     *linesize = diff;
@@ -163,7 +360,7 @@ char *strbuf_strdup(strbuf_t b)
         return NULL;
     }
 
-    return strdup(b->buf);
+    return strndup(b->buf + b->start, b->end - b->start);
 }
 
 size_t strbuf_len(strbuf_t b)
@@ -172,27 +369,25 @@ size_t strbuf_len(strbuf_t b)
         return 0;
     }
 
-    return b->end;
+    return b->end - b->start;
 }
 
 int strbuf_getc(strbuf_t b)
 {
-    if (b == NULL || b->end <= 0) {
+    if (b == NULL || b->end == b->start) {
         return -1;
     }
 
-    return *b->buf;
+    return b->buf[b->start];
 }
 
 int strbuf_delete(strbuf_t b, size_t how)
 {
-    if (b == NULL || how > b->end) {
+    if (b == NULL || how > b->end - b->start) {
         return -1;
     }
 
-    b->end -= how;
-    memmove(b->buf, b->buf+how, b->end);
-    memset(b->buf + b->end, 0, b->bufsize - b->end);
+    strbuf_consume(b, how);
 
     return 0;
 }
@@ -1,10 +1,34 @@
 #include <irc/tag.h>
-#include <irc/strbuf.h>
 
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
 
+irc_tag_key_t irc_tag_key(char const *key, size_t len)
+{
+    static struct {
+        char const *name;
+        size_t len;
+    } const keys[irc_tag_key_max] = {
+        [irc_tag_key_time] = { "time", 4 },
+        [irc_tag_key_msgid] = { "msgid", 5 },
+        [irc_tag_key_account] = { "account", 7 },
+        [irc_tag_key_batch] = { "batch", 5 },
+        [irc_tag_key_label] = { "label", 5 },
+    };
+
+    return_if_true(key == NULL, irc_tag_key_unknown);
+
+    for (size_t k = irc_tag_key_unknown + 1; k < irc_tag_key_max; k++) {
+        if (keys[k].len == len && keys[k].name[0] == key[0] &&
+            memcmp(keys[k].name, key, len) == 0) {
+            return (irc_tag_key_t)k;
+        }
+    }
+
+    return irc_tag_key_unknown;
+}
+
 irc_tag_t irc_tag_new(void)
 {
     irc_tag_t t = NULL;
@@ -80,119 +104,173 @@ irc_tag_t irc_tag_make(char const *key, char const *value)
 
 irc_error_t irc_tag_string(irc_tag_t t, char **s, size_t *slen)
 {
-    strbuf_t buf = NULL;
+    size_t keylen = 0;
+    size_t len = 0;
+    char *str = NULL;
 
     if (t == NULL || t->key == NULL || s == NULL) {
         return irc_error_argument;
     }
 
-    buf = strbuf_new();
-    strbuf_append(buf, t->key, strlen(t->key));
+    keylen = strlen(t->key);
+    len = keylen;
     if (t->value != NULL) {
-        char *value = irc_tag_escape(t->value);
+        len += 1 + irc_tag_escape_into(NULL, t->value);
+    }
 
-        strbuf_append(buf, "=", 1);
-        strbuf_append(buf, value, strlen(value));
-        free(value);
+    str = malloc(len + 1);
+    if (str == NULL) {
+        return irc_error_memory;
     }
 
-    *s = strbuf_strdup (buf);
+    memcpy(str, t->key, keylen);
+    if (t->value != NULL) {
+        str[keylen] = '=';
+        irc_tag_escape_into(str + keylen + 1, t->value);
+    }
+    str[len] = '\0';
+
+    *s = str;
     if (slen != NULL) {
-        *slen = strbuf_len(buf);
+        *slen = len;
     }
-    strbuf_free(buf);
 
     return irc_error_success;
 }
 
-char *irc_tag_unescape(char const *value)
+size_t irc_tag_unescape_into(char *dst, char const *value, size_t len)
 {
-    char *ret = NULL;
-    strbuf_t unescaped = NULL;
-
-    unescaped = strbuf_new();
+    char const *end = value + len;
+    char *d = dst;
+
+    /* never writes ahead of what it reads, so dst may be value itself.
+     * Runs without a backslash are moved in bulk, and not at all when
+     * unescaping in place before the first escape.
+     */
+    while (value < end) {
+        char const *esc = memchr(value, '\\', end - value);
+        size_t run = (esc != NULL ? esc : end) - value;
+
+        if (d != value) {
+            memmove(d, value, run);
+        }
+        d += run;
+        value += run;
 
-    while (value && value[0]) {
-        switch (value[0]) {
-        case '\\':
-            value++;
-            switch (value[0]) {
-            case ':':
-                strbuf_append(unescaped, ";", 1);
-                value++;
-                break;
-            case 's':;
-                strbuf_append(unescaped, " ", 1);
-                value++;
-                break;
-            case '\\':
-                strbuf_append(unescaped, "\\", 1);
-                value++;
-                break;
-            case 'r':
-                strbuf_append(unescaped, "\r", 1);
-                value++;
-                break;
-            case 'n':
-                strbuf_append(unescaped, "\n", 1);
-                value++;
-                break;
-            default:
-                if (value[0]) {
-                    strbuf_append(unescaped, &value[0], 1);
-                    value++;
-                }
-                break;
-            }
+        if (esc == NULL) {
             break;
-        default:
-            strbuf_append(unescaped, &value[0], 1);
-            value++;
+        }
+
+        value++;
+        if (value == end) {
             break;
         }
+
+        switch (value[0]) {
+        case ':': *d++ = ';'; break;
+        case 's': *d++ = ' '; break;
+        case 'r': *d++ = '\r'; break;
+        case 'n': *d++ = '\n'; break;
+        default: *d++ = value[0]; break;
+        }
+        value++;
     }
 
-    if (strbuf_len(unescaped) > 0) {
-        ret = strbuf_strdup(unescaped);
+    return (size_t)(d - dst);
+}
+
+char *irc_tag_unescape(char const *value)
+{
+    char *ret = NULL;
+    size_t len = 0;
+
+    if (value == NULL) {
+        return NULL;
+    }
+
+    len = strlen(value);
+    ret = malloc(len + 1);
+    if (ret == NULL) {
+        return NULL;
     }
-    strbuf_free(unescaped);
+
+    if (memchr(value, '\\', len) == NULL) {
+        memcpy(ret, value, len);
+    } else {
+        len = irc_tag_unescape_into(ret, value, len);
+    }
+
+    if (len == 0) {
+        free(ret);
+        return NULL;
+    }
+    ret[len] = '\0';
 
     return ret;
 }
 
-char *irc_tag_escape(char const *value)
+/* Writes the escaped form of value to dst, and returns its length. With
+ * dst being NULL only the length is worked out.
+ */
+size_t irc_tag_escape_into(char *dst, char const *value)
 {
-    char *ret = NULL;
-    strbuf_t escaped = NULL;
+    static char const special[] = "; \\\r\n";
+    static char const escapes[] = ":s\\rn";
+    size_t len = 0;
 
-    escaped = strbuf_new();
+    return_if_true(value == NULL, 0);
 
-    while (value && value[0]) {
-        switch (value[0]) {
-        case ';':
-            strbuf_append(escaped, "\\:", 2);
-            break;
-        case ' ':
-            strbuf_append(escaped, "\\s", 2);
-            break;
-        case '\\':
-            strbuf_append(escaped, "\\\\", 2);
-            break;
-        case '\r':
-            strbuf_append(escaped, "\\r", 2);
-            break;
-        case '\n':
-            strbuf_append(escaped, "\\n", 2);
-            break;
-        default:
-            strbuf_append(escaped, value, 1);
+    /* copy the runs between special characters in bulk
+     */
+    for (;;) {
+        size_t run = strcspn(value, special);
+
+        if (dst != NULL) {
+            memcpy(dst + len, value, run);
+        }
+        len += run;
+        value += run;
+
+        if (*value == '\0') {
             break;
         }
+
+        if (dst != NULL) {
+            dst[len] = '\\';
+            dst[len + 1] = escapes[strchr(special, *value) - special];
+        }
+        len += 2;
         value++;
     }
 
-    ret = strbuf_strdup(escaped);
-    strbuf_free(escaped);
+    return len;
+}
+
+char *irc_tag_escape(char const *value)
+{
+    char *ret = NULL;
+    size_t len = 0;
+
+    if (value == NULL) {
+        return NULL;
+    }
+
+    len = strlen(value);
+    if (value[strcspn(value, "; \\\r\n")] == '\0') {
+        /* nothing to escape
+         */
+        ret = malloc(len + 1);
+        if (ret != NULL) {
+            memcpy(ret, value, len + 1);
+        }
+        return ret;
+    }
+
+    ret = malloc(irc_tag_escape_into(NULL, value) + 1);
+    if (ret == NULL) {
+        return NULL;
+    }
+    ret[irc_tag_escape_into(ret, value)] = '\0';
 
     return ret;
 }
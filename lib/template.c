@@ -0,0 +1,180 @@
+#include <irc/template.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+/* The shape is kept as the literal runs around each slot, so rendering is
+ * nothing but copying runs and arguments back to back.
+ */
+typedef struct {
+    size_t off;
+    size_t len;
+} irc_template_run_t;
+
+struct irc_template_
+{
+    char *literal;
+    irc_template_run_t runs[IRC_TEMPLATE_MAXSLOTS + 1];
+    bool trailing[IRC_TEMPLATE_MAXSLOTS];
+    size_t slots;
+    size_t fixed;
+};
+
+irc_template_t irc_template_new(char const *shape)
+{
+    irc_template_t t = NULL;
+    char const *p = NULL;
+    size_t len = 0;
+
+    return_if_true(shape == NULL, NULL);
+
+    t = calloc(1, sizeof(struct irc_template_));
+    if (t == NULL) {
+        return NULL;
+    }
+
+    t->literal = malloc(strlen(shape) + 1);
+    if (t->literal == NULL) {
+        free(t);
+        return NULL;
+    }
+
+    for (p = shape; *p != '\0'; p++) {
+        if (p[0] != '%' || p[1] != 's') {
+            t->literal[len++] = *p;
+            continue;
+        }
+
+        if (t->slots == IRC_TEMPLATE_MAXSLOTS) {
+            irc_template_free(t);
+            return NULL;
+        }
+
+        t->runs[t->slots].len = len - t->runs[t->slots].off;
+        t->trailing[t->slots] = (len >= 2 &&
+                                 t->literal[len - 2] == ' ' &&
+                                 t->literal[len - 1] == ':');
+        ++t->slots;
+        t->runs[t->slots].off = len;
+        ++p;
+    }
+    t->runs[t->slots].len = len - t->runs[t->slots].off;
+    t->fixed = len;
+
+    /* only the last argument may be a final one
+     */
+    for (size_t i = 0; i + 1 < t->slots; i++) {
+        if (t->trailing[i]) {
+            irc_template_free(t);
+            return NULL;
+        }
+    }
+
+    return t;
+}
+
+void irc_template_free(irc_template_t t)
+{
+    return_if_true(t == NULL,);
+
+    free(t->literal);
+    free(t);
+}
+
+size_t irc_template_slots(irc_template_t t)
+{
+    return_if_true(t == NULL, 0);
+    return t->slots;
+}
+
+static bool irc_template_valid(irc_slice_t const *s, bool trailing)
+{
+    if (!trailing && (s->len == 0 || s->ptr[0] == ':')) {
+        return false;
+    }
+
+    for (size_t i = 0; i < s->len; i++) {
+        char c = s->ptr[i];
+
+        /* nothing may end the line early, or split a word
+         */
+        if (c == '\r' || c == '\n' || c == '\0' || (c == ' ' && !trailing)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+ssize_t irc_template_render(irc_template_t t, char *buf, size_t cap,
+                            irc_slice_t const *args, size_t argslen)
+{
+    size_t len = 0;
+    size_t off = 0;
+
+    return_if_true(t == NULL || argslen != t->slots, -1);
+    return_if_true(args == NULL && argslen > 0, -1);
+    return_if_true(buf == NULL && cap > 0, -1);
+
+    len = t->fixed + 2;
+    for (size_t i = 0; i < argslen; i++) {
+        if (args[i].ptr == NULL && args[i].len > 0) {
+            return -1;
+        }
+        if (!irc_template_valid(args + i, t->trailing[i])) {
+            return -1;
+        }
+        len += args[i].len;
+    }
+
+    if (len > cap) {
+        return len;
+    }
+
+    for (size_t i = 0; i <= argslen; i++) {
+        memcpy(buf + off, t->literal + t->runs[i].off, t->runs[i].len);
+        off += t->runs[i].len;
+
+        if (i < argslen) {
+            memcpy(buf + off, args[i].ptr, args[i].len);
+            off += args[i].len;
+        }
+    }
+    memcpy(buf + off, "\r\n", 2);
+
+    return len;
+}
+
+irc_message_t irc_template_message(irc_template_t t, irc_pool_t pool,
+                                   irc_slice_t const *args, size_t argslen)
+{
+    irc_message_view_t v;
+    char small[512];
+    char *buf = small;
+    irc_message_t m = NULL;
+    ssize_t len = 0;
+
+    len = irc_template_render(t, small, sizeof(small), args, argslen);
+    return_if_true(len < 0, NULL);
+
+    if ((size_t)len > sizeof(small)) {
+        buf = malloc(len);
+        if (buf == NULL) {
+            return NULL;
+        }
+        irc_template_render(t, buf, len, args, argslen);
+    }
+
+    /* the view points into buf, which is copied into the message
+     */
+    if (IRC_SUCCESS(irc_message_view_parse(&v, buf, len - 2))) {
+        m = irc_message_view_promote_pool(&v, 0, pool);
+    }
+
+    if (buf != small) {
+        free(buf);
+    }
+
+    return m;
+}
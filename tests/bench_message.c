@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <irc/message.h>
+
+#define ROUNDS 200000
+
+static char const *corpus[] = {
+    "PING :irc.example.org",
+    ":nick!user@host.example.org PRIVMSG #channel :the quick brown fox "
+    "jumps over the lazy dog",
+    ":nick!user@host.example.org JOIN #channel",
+    ":irc.example.org 353 me = #channel :alice bob carol dave eve mallory "
+    "trent victor walter",
+    "@time=2023-01-01T00:00:00.000Z;msgid=abcdef;account=nick "
+    ":nick!user@host.example.org PRIVMSG #channel :tagged message with "
+    "a few words in it",
+    ":irc.example.org 005 me CHANTYPES=# EXCEPTS INVEX CHANMODES=eIbq,k,flj,"
+    "CFLMPQScgimnprstuz CHANLIMIT=#:250 PREFIX=(ov)@+ MAXLIST=bqeI:100 "
+    "MODES=4 NETWORK=example KNOCK STATUSMSG=@+ CALLERID=g "
+    ":are supported by this server",
+};
+
+#define CORPUS (sizeof(corpus) / sizeof(corpus[0]))
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(char const *name, double t)
+{
+    printf("%-20s %10.1f ns/line %10.2f Mlines/s\n", name,
+           t * 1e9 / (ROUNDS * CORPUS), (ROUNDS * CORPUS) / t / 1e6);
+}
+
+int main(int ac, char **av)
+{
+    size_t lens[CORPUS];
+    size_t sink = 0;
+    double t = 0;
+    irc_pool_t pool = NULL;
+    struct iovec iov[CORPUS];
+
+    for (size_t i = 0; i < CORPUS; i++) {
+        lens[i] = strlen(corpus[i]);
+    }
+
+    t = now();
+    for (size_t r = 0; r < ROUNDS; r++) {
+        for (size_t i = 0; i < CORPUS; i++) {
+            irc_message_view_t v;
+
+            irc_message_view_parse(&v, corpus[i], lens[i]);
+            sink += v.argslen;
+        }
+    }
+    report("view", now() - t);
+
+    t = now();
+    for (size_t r = 0; r < ROUNDS; r++) {
+        for (size_t i = 0; i < CORPUS; i++) {
+            irc_message_t m = irc_message_parse_packed(corpus[i], lens[i]);
+
+            sink += m->argslen;
+            irc_message_unref(m);
+        }
+    }
+    report("packed", now() - t);
+
+    for (size_t i = 0; i < CORPUS; i++) {
+        iov[i].iov_base = (void *)corpus[i];
+        iov[i].iov_len = lens[i];
+    }
+    t = now();
+    for (size_t r = 0; r < ROUNDS; r++) {
+        irc_message_t msgs[CORPUS];
+
+        irc_message_parse_batch(iov, CORPUS, msgs, 0);
+        sink += msgs[0]->argslen;
+        irc_message_unref_batch(msgs, CORPUS);
+    }
+    report("batch", now() - t);
+
+    pool = irc_pool_new(64);
+    t = now();
+    for (size_t r = 0; r < ROUNDS; r++) {
+        for (size_t i = 0; i < CORPUS; i++) {
+            irc_message_view_t v;
+            irc_message_t m = NULL;
+
+            irc_message_view_parse(&v, corpus[i], lens[i]);
+            m = irc_message_view_promote_pool(&v, 0, pool);
+            sink += m->argslen;
+            irc_message_unref(m);
+        }
+    }
+    report("pooled", now() - t);
+    irc_pool_free(pool);
+
+    t = now();
+    for (size_t r = 0; r < ROUNDS; r++) {
+        for (size_t i = 0; i < CORPUS; i++) {
+            irc_message_t m = irc_message_parse2(corpus[i], lens[i]);
+
+            sink += m->argslen;
+            irc_message_unref(m);
+        }
+    }
+    report("parse", now() - t);
+
+    return (sink == 0);
+}
@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <irc/irc.h>
+#include <irc/message.h>
+
+#define MESSAGES 400000
+
+typedef struct {
+    irc_t irc;
+    irc_message_t msg;
+    size_t count;
+} producer_t;
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *produce(void *arg)
+{
+    producer_t *p = arg;
+
+    for (size_t i = 0; i < p->count; i++) {
+        irc_message_ref(p->msg);
+        irc_queue(p->irc, p->msg);
+    }
+
+    return NULL;
+}
+
+/* n producers queue one shared message over and over, while this thread
+ * pops and serialises them, sleeping whenever the queue runs dry
+ */
+static void run(size_t n)
+{
+    pthread_t threads[16];
+    producer_t producers[16];
+    irc_t irc = irc_new();
+    irc_message_t msg = NULL;
+    size_t total = (MESSAGES / n) * n;
+    double start = 0;
+
+    msg = irc_message_make(NULL, "PRIVMSG", "#channel",
+                           "the quick brown fox jumps over the lazy dog",
+                           NULL);
+
+    start = now();
+    for (size_t k = 0; k < n; k++) {
+        producers[k].irc = irc;
+        producers[k].msg = msg;
+        producers[k].count = MESSAGES / n;
+        pthread_create(threads + k, NULL, produce, producers + k);
+    }
+
+    for (size_t got = 0; got < total; got++) {
+        char *line = NULL;
+        size_t len = 0;
+
+        if (irc_pop_wait(irc, &line, &len, 1000) != irc_error_success) {
+            fprintf(stderr, "lost messages after %zu\n", got);
+            break;
+        }
+        free(line);
+    }
+
+    for (size_t k = 0; k < n; k++) {
+        pthread_join(threads[k], NULL);
+    }
+
+    printf("%2zu producers %10.1f ns/message\n", n,
+           (now() - start) * 1e9 / total);
+
+    irc_message_unref(msg);
+    irc_free(irc);
+}
+
+int main(int ac, char **av)
+{
+    run(1);
+    run(4);
+    run(16);
+
+    return 0;
+}
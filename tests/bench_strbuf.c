@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <irc/strbuf.h>
+
+#define LINE ":nick!user@host.example.org PRIVMSG #channel :" \
+    "the quick brown fox jumps over the lazy dog\r\n"
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double drain(size_t burst)
+{
+    strbuf_t b = strbuf_new();
+    size_t linelen = strlen(LINE);
+    size_t lines = burst / linelen;
+    char *data = NULL;
+    char *line = NULL;
+    size_t len = 0;
+    double start = 0;
+
+    data = calloc(lines, linelen);
+    for (size_t i = 0; i < lines; i++) {
+        memcpy(data + (i * linelen), LINE, linelen);
+    }
+    strbuf_append(b, data, lines * linelen);
+    free(data);
+
+    start = now();
+    while (strbuf_getstr(b, &line, &len, "\r\n") == 0) {
+        free(line);
+    }
+    start = now() - start;
+
+    strbuf_free(b);
+
+    return start;
+}
+
+int main(int ac, char **av)
+{
+    size_t burst = 0;
+
+    printf("%10s %12s %12s\n", "burst", "total (ms)", "ns/byte");
+    for (burst = 25 * 1024; burst <= 3200 * 1024; burst *= 2) {
+        double t = drain(burst);
+
+        printf("%10zu %12.3f %12.3f\n", burst, t * 1e3, t * 1e9 / burst);
+    }
+
+    return 0;
+}
@@ -0,0 +1,119 @@
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <cmocka.h>
+#include <stdint.h>
+
+#include <irc/casemap.h>
+#include <irc/message.h>
+
+#define EQUAL(cm, a, b) irc_casemap_equal(cm, a, strlen(a), b, strlen(b))
+#define CMP(cm, a, b) irc_casemap_cmp(cm, a, strlen(a), b, strlen(b))
+
+static void test_casemap_parse(void **data)
+{
+    assert_int_equal(irc_casemap_parse("ascii", 5), irc_casemap_ascii);
+    assert_int_equal(irc_casemap_parse("strict-rfc1459", 14),
+                     irc_casemap_strict_rfc1459);
+    assert_int_equal(irc_casemap_parse("rfc1459", 7), irc_casemap_rfc1459);
+    assert_int_equal(irc_casemap_parse("rfc7613", 7), irc_casemap_rfc1459);
+    assert_int_equal(irc_casemap_parse(NULL, 0), irc_casemap_rfc1459);
+}
+
+static void test_casemap_fold(void **data)
+{
+    irc_casemap_t maps[] = {
+        irc_casemap_ascii, irc_casemap_strict_rfc1459, irc_casemap_rfc1459
+    };
+    char src[256], dst[256];
+
+    assert_int_equal(irc_casemap_fold(irc_casemap_ascii, '['), '[');
+    assert_int_equal(irc_casemap_fold(irc_casemap_strict_rfc1459, '['), '{');
+    assert_int_equal(irc_casemap_fold(irc_casemap_strict_rfc1459, '^'), '^');
+    assert_int_equal(irc_casemap_fold(irc_casemap_rfc1459, '^'), '~');
+    assert_int_equal(irc_casemap_fold(irc_casemap_rfc1459, '\xc1'), '\xc1');
+
+    /* folding whole words has to agree with folding bytes
+     */
+    for (size_t c = 0; c < 256; c++) {
+        src[c] = (char)c;
+    }
+    for (size_t m = 0; m < 3; m++) {
+        irc_casemap_foldn(maps[m], dst, src, sizeof(src));
+        for (size_t c = 0; c < 256; c++) {
+            assert_int_equal(dst[c], irc_casemap_fold(maps[m], src[c]));
+        }
+    }
+}
+
+static void test_casemap_equal(void **data)
+{
+    assert_true(EQUAL(irc_casemap_rfc1459, "Nick[Away]", "nick{away}"));
+    assert_true(EQUAL(irc_casemap_rfc1459, "a^b", "A~B"));
+    assert_false(EQUAL(irc_casemap_strict_rfc1459, "a^b", "A~B"));
+    assert_true(EQUAL(irc_casemap_strict_rfc1459, "A\\B", "a|b"));
+    assert_false(EQUAL(irc_casemap_ascii, "A\\B", "a|b"));
+    assert_true(EQUAL(irc_casemap_ascii, "#SomeVeryLongChannelName",
+                      "#someverylongchannelname"));
+    assert_false(EQUAL(irc_casemap_ascii, "#SomeVeryLongChannelName",
+                       "#someverylongchannelnamf"));
+    assert_false(EQUAL(irc_casemap_ascii, "nick", "nick_"));
+}
+
+static void test_casemap_cmp(void **data)
+{
+    assert_int_equal(CMP(irc_casemap_ascii, "ABCDEFGHIJ", "abcdefghij"), 0);
+    assert_true(CMP(irc_casemap_ascii, "abcdefghiJ", "ABCDEFGHIK") < 0);
+    assert_true(CMP(irc_casemap_ascii, "abc", "ABCD") < 0);
+    assert_true(CMP(irc_casemap_ascii, "b", "A") > 0);
+    assert_int_equal(CMP(irc_casemap_rfc1459, "[]", "{}"), 0);
+}
+
+static void test_casemap_hash(void **data)
+{
+    char const *a = "#Channel[With]LongName";
+    char const *b = "#cHANNEL{wITH}lONGnAME";
+
+    assert_true(irc_casemap_hash(irc_casemap_rfc1459, a, strlen(a)) ==
+                irc_casemap_hash(irc_casemap_rfc1459, b, strlen(b)));
+    assert_true(irc_casemap_hash(irc_casemap_ascii, a, strlen(a)) !=
+                irc_casemap_hash(irc_casemap_ascii, b, strlen(b)));
+    assert_true(irc_casemap_hash(irc_casemap_ascii, "ab", 2) !=
+                irc_casemap_hash(irc_casemap_ascii, "ab\0", 3));
+}
+
+static void test_casemap_message(void **data)
+{
+    irc_message_t m = irc_message_parse_packed(
+        ":Nick[1]!u@h PRIVMSG #Chan :hi", -1
+        );
+
+    assert_non_null(m);
+    assert_false(irc_message_prefix_nick(m, "nick{1}"));
+    assert_true(irc_message_prefix_nick_casemap(m, "nick{1}",
+                                                irc_casemap_rfc1459));
+    assert_false(irc_message_prefix_nick_casemap(m, "nick{1}",
+                                                 irc_casemap_ascii));
+    assert_true(irc_message_arg_is_casemap(m, 0, "#chan",
+                                           irc_casemap_ascii));
+    assert_false(irc_message_arg_is_casemap(m, 2, "#chan",
+                                            irc_casemap_ascii));
+    irc_message_unref(m);
+}
+
+int main(int ac, char **av)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_casemap_parse),
+        cmocka_unit_test(test_casemap_fold),
+        cmocka_unit_test(test_casemap_equal),
+        cmocka_unit_test(test_casemap_cmp),
+        cmocka_unit_test(test_casemap_hash),
+        cmocka_unit_test(test_casemap_message),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
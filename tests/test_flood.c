@@ -0,0 +1,235 @@
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <cmocka.h>
+#include <stdint.h>
+
+#include <irc/flood.h>
+#include <irc/irc.h>
+
+#include <poll.h>
+
+static int setup(void **data)
+{
+    /* five lines ahead, one every two seconds, and as much again for
+     * every 100 bytes
+     */
+    irc_flood_t f = irc_flood_new(5, 2000, 100);
+    if (f == NULL) {
+        return -1;
+    }
+
+    *data = f;
+
+    return 0;
+}
+
+static int teardown(void **data)
+{
+    irc_flood_free(*data);
+
+    return 0;
+}
+
+static void test_flood_burst(void **data)
+{
+    irc_flood_t f = *data;
+    uint64_t now = 1000000;
+
+    assert_int_equal(irc_flood_cost(f, 0), 2000);
+    assert_int_equal(irc_flood_cost(f, 10), 2200);
+    assert_int_equal(irc_flood_cost(f, 250), 7000);
+
+    for (int k = 0; k < 5; k++) {
+        assert_int_equal(irc_flood_delay(f, 0, now), 0);
+        assert_return_code(irc_flood_take(f, 0, now), irc_error_success);
+    }
+
+    assert_int_equal(irc_flood_take(f, 0, now), irc_error_again);
+    assert_int_equal(irc_flood_delay(f, 0, now), 2000);
+    assert_int_equal(irc_flood_delay(f, 0, now + 500), 1500);
+    assert_return_code(irc_flood_take(f, 0, now + 2000), irc_error_success);
+
+    /* longer lines cost more
+     */
+    assert_int_equal(irc_flood_delay(f, 250, now + 2000), 7000);
+
+    irc_flood_reset(f);
+    assert_int_equal(irc_flood_delay(f, 250, now + 2000), 0);
+}
+
+static void test_flood_oversized(void **data)
+{
+    irc_flood_t f = *data;
+    uint64_t now = 1000000;
+
+    /* costs more than the whole window, so it waits until nothing is owed
+     */
+    assert_int_equal(irc_flood_cost(f, 500), 12000);
+    assert_return_code(irc_flood_take(f, 500, now), irc_error_success);
+    assert_int_equal(irc_flood_delay(f, 500, now), 12000);
+    assert_int_equal(irc_flood_delay(f, 0, now), 4000);
+}
+
+static void test_flood_sustained(void **data)
+{
+    irc_flood_t f = *data;
+    uint64_t start = 1000000, now = start;
+    uint64_t spent = 0;
+    size_t sent = 0;
+
+    /* a sender that always waits exactly as long as it is told stays at
+     * the limit, but never goes over it
+     */
+    while (now < start + 600000) {
+        uint64_t delay = irc_flood_delay(f, 50, now);
+
+        now += delay;
+        assert_return_code(irc_flood_take(f, 50, now), irc_error_success);
+        spent += irc_flood_cost(f, 50);
+        ++sent;
+
+        assert_true(spent <= now - start + 5 * 2000);
+    }
+
+    /* 600 seconds at 3 seconds per line, plus the burst
+     */
+    assert_in_range(sent, 200 + 3, 200 + 4);
+}
+
+static void test_flood_irc(void **data)
+{
+    irc_t irc = irc_new();
+    irc_flood_t f = NULL;
+    char *line = NULL;
+    size_t len = 0;
+
+    assert_non_null(irc);
+
+    assert_int_equal(irc_pop_timeout(irc), -1);
+
+    assert_return_code(irc_setopt(irc, ircopt_flood, 2, 60000, 0),
+                       irc_error_success);
+    assert_return_code(irc_getopt(irc, ircopt_flood, &f), irc_error_success);
+    assert_non_null(f);
+
+    for (int k = 0; k < 3; k++) {
+        irc_queue_command(irc, "PRIVMSG", "#a", "hi", NULL);
+    }
+
+    for (int k = 0; k < 2; k++) {
+        assert_int_equal(irc_pop_timeout(irc), 0);
+        assert_return_code(irc_pop(irc, &line, &len), irc_error_success);
+        free(line);
+    }
+
+    /* out of budget: the PONG jumps ahead of the third line, but has to
+     * wait all the same
+     */
+    irc_queue_command(irc, "PONG", "tok", NULL);
+    assert_int_equal(irc_pop(irc, &line, &len), irc_error_again);
+    assert_in_range(irc_pop_timeout(irc), 59000, 60000);
+    assert_int_equal(irc_pop_wait(irc, &line, &len, 0), irc_error_again);
+
+    /* turning it off lets everything through
+     */
+    assert_return_code(irc_setopt(irc, ircopt_flood, 0, 0, 0),
+                       irc_error_success);
+    assert_return_code(irc_pop(irc, &line, &len), irc_error_success);
+    assert_string_equal(line, "PONG tok\r\n");
+    free(line);
+    assert_return_code(irc_pop(irc, &line, &len), irc_error_success);
+    assert_string_equal(line, "PRIVMSG #a hi\r\n");
+    free(line);
+
+    irc_free(irc);
+}
+
+static void test_flood_held(void **data)
+{
+    irc_t irc = irc_new();
+    char *line = NULL;
+    size_t len = 0;
+
+    assert_non_null(irc);
+    assert_return_code(irc_setopt(irc, ircopt_flood, 1, 2000, 0),
+                       irc_error_success);
+
+    irc_queue_command(irc, "PRIVMSG", "#a", "b1", NULL);
+    irc_queue_command(irc, "PRIVMSG", "#a", "b2", NULL);
+    assert_return_code(irc_pop(irc, &line, &len), irc_error_success);
+    free(line);
+
+    /* b2 is already held back when the PONG comes in, it still goes first
+     */
+    assert_in_range(irc_pop_timeout(irc), 1, 2000);
+    irc_queue_command(irc, "PONG", "tok", NULL);
+
+    assert_return_code(irc_setopt(irc, ircopt_flood, 0, 0, 0),
+                       irc_error_success);
+    assert_return_code(irc_pop(irc, &line, &len), irc_error_success);
+    assert_string_equal(line, "PONG tok\r\n");
+    free(line);
+    assert_return_code(irc_pop(irc, &line, &len), irc_error_success);
+    assert_string_equal(line, "PRIVMSG #a b2\r\n");
+    free(line);
+    assert_int_equal(irc_pop(irc, &line, &len), irc_error_nodata);
+
+    irc_free(irc);
+}
+
+static void test_flood_poll(void **data)
+{
+    irc_t irc = irc_new();
+    char *line = NULL;
+    size_t len = 0;
+    int passes = 0;
+    uint64_t start = 0;
+
+    assert_non_null(irc);
+    assert_return_code(irc_setopt(irc, ircopt_flood, 1, 300, 0),
+                       irc_error_success);
+
+    for (int k = 0; k < 3; k++) {
+        irc_queue_command(irc, "PRIVMSG", "#a", "hi", NULL);
+    }
+    assert_return_code(irc_pop(irc, &line, &len), irc_error_success);
+    free(line);
+
+    /* the event loop the documentation suggests sleeps until the deadline,
+     * instead of waking up for the lines still queued behind it
+     */
+    start = irc_flood_now();
+    for (int sent = 0; sent < 2; passes++) {
+        struct pollfd pfd = { irc_queue_fd(irc), POLLIN, 0 };
+
+        assert_true(passes < 10);
+        poll(&pfd, 1, irc_pop_timeout(irc));
+        if (irc_pop(irc, &line, &len) == irc_error_success) {
+            free(line);
+            ++sent;
+        }
+    }
+    assert_true(irc_flood_now() - start >= 590);
+
+    irc_free(irc);
+}
+
+int main(int ac, char **av)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_flood_burst, setup, teardown),
+        cmocka_unit_test_setup_teardown(test_flood_oversized, setup,
+                                        teardown),
+        cmocka_unit_test_setup_teardown(test_flood_sustained, setup,
+                                        teardown),
+        cmocka_unit_test(test_flood_irc),
+        cmocka_unit_test(test_flood_held),
+        cmocka_unit_test(test_flood_poll),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
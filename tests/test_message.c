@@ -6,6 +6,7 @@
 #include <stdint.h>
 
 #include <irc/message.h>
+#include <irc/irc.h>
 
 static void test_message_parse_without_tag(void **data)
 {
@@ -125,6 +126,295 @@ static void test_message_parse_with_multiple_tag(void **data)
     irc_message_unref(m);
 }
 
+static void test_message_parse_unterminated(void **data)
+{
+    irc_message_t m = irc_message_new();
+    const char *str = ":prefix PRIVMSG #channel :two  spaces\r\n:next";
+    irc_error_t error = irc_error_internal;
+
+    error = irc_message_parse(m, str, strchr(str, '\r') - str);
+    assert_int_equal(error, irc_error_success);
+    assert_string_equal(m->prefix, "prefix");
+    assert_string_equal(m->command, "PRIVMSG");
+    assert_int_equal(m->argslen, 2);
+    assert_string_equal(m->args[0], "#channel");
+    assert_string_equal(m->args[1], "two  spaces");
+
+    irc_message_unref(m);
+}
+
+static void assert_message_equal(irc_message_t a, irc_message_t b)
+{
+    if (a->prefix == NULL || b->prefix == NULL) {
+        assert_ptr_equal(a->prefix, b->prefix);
+    } else {
+        assert_string_equal(a->prefix, b->prefix);
+    }
+    assert_string_equal(a->command, b->command);
+
+    assert_int_equal(a->argslen, b->argslen);
+    for (size_t i = 0; i < a->argslen; i++) {
+        assert_string_equal(a->args[i], b->args[i]);
+    }
+
+    assert_int_equal(a->tagslen, b->tagslen);
+    for (size_t i = 0; i < a->tagslen; i++) {
+        assert_string_equal(a->tags[i]->key, b->tags[i]->key);
+        if (a->tags[i]->value == NULL || b->tags[i]->value == NULL) {
+            assert_ptr_equal(a->tags[i]->value, b->tags[i]->value);
+        } else {
+            assert_string_equal(a->tags[i]->value, b->tags[i]->value);
+        }
+    }
+}
+
+static char const *lines[] = {
+    "PING :irc.example.org",
+    ":prefix COMMAND Arg",
+    ":guest PRIVMSG #channel :haha :D",
+    ":guest PRIVMSG #channel ::-)",
+    ":guest PRIVMSG #channel :",
+    "@key1=value1;key2;key3=value3 :prefix COMMAND Arg",
+    "@a=one\\stwo;b=\\:;c= :n!u@h PRIVMSG #c :tagged",
+    ":srv 005 nick A B C D E F G H I J K L M N O P :are supported",
+};
+
+static void test_message_parse_packed(void **data)
+{
+    for (size_t i = 0; i < sizeof(lines) / sizeof(lines[0]); i++) {
+        irc_message_t m = irc_message_parse2(lines[i], -1);
+        irc_message_t p = irc_message_parse_packed(lines[i], -1);
+
+        assert_ptr_not_equal(m, NULL);
+        assert_ptr_not_equal(p, NULL);
+        assert_true(p->flags & irc_message_flag_packed);
+
+        assert_message_equal(m, p);
+
+        irc_message_unref(m);
+        irc_message_unref(p);
+    }
+}
+
+static void test_message_parse_batch(void **data)
+{
+    size_t const n = sizeof(lines) / sizeof(lines[0]);
+    struct iovec iov[sizeof(lines) / sizeof(lines[0])];
+    irc_message_t batch[sizeof(lines) / sizeof(lines[0])];
+    irc_message_t kept = NULL;
+
+    for (size_t i = 0; i < n; i++) {
+        iov[i].iov_base = (void *)lines[i];
+        iov[i].iov_len = strlen(lines[i]);
+    }
+
+    assert_return_code(irc_message_parse_batch(iov, n, batch, 0),
+                       irc_error_success);
+    for (size_t i = 0; i < n; i++) {
+        irc_message_t m = irc_message_parse2(lines[i], -1);
+
+        assert_non_null(batch[i]);
+        assert_non_null(batch[i]->arena);
+        assert_message_equal(m, batch[i]);
+        irc_message_unref(m);
+    }
+
+    /* a message kept past the batch keeps the arena around
+     */
+    kept = batch[2];
+    irc_message_ref(kept);
+    irc_message_unref_batch(batch, n);
+    assert_null(batch[0]);
+    assert_string_equal(kept->args[1], "haha :D");
+    irc_message_unref(kept);
+
+    assert_return_code(irc_message_parse_batch(iov, n, batch,
+                                               irc_message_flag_lazytags),
+                       irc_error_success);
+    for (size_t i = 0; i < n; i++) {
+        irc_message_t m = irc_message_parse2(lines[i], -1);
+
+        assert_return_code(irc_message_tags_decode(batch[i]),
+                           irc_error_success);
+        assert_message_equal(m, batch[i]);
+        irc_message_unref(m);
+    }
+    irc_message_unref_batch(batch, n);
+}
+
+static void test_message_parse_maxargs(void **data)
+{
+    irc_message_t m = irc_message_parse_packed(lines[7], -1);
+
+    assert_int_equal(m->argslen, IRC_MESSAGE_MAXARGS);
+    assert_string_equal(m->args[0], "nick");
+    assert_string_equal(m->args[13], "M");
+    assert_string_equal(m->args[14], "N O P :are supported");
+
+    irc_message_unref(m);
+}
+
+static void test_message_view(void **data)
+{
+    const char *str = "@time=12:00;msgid=a\\sb :nick!user@host PRIVMSG #c :hi there";
+    irc_message_view_t v;
+    irc_slice_t key, value;
+    char const *pos = NULL;
+    irc_message_t m = NULL;
+
+    assert_int_equal(irc_message_view_parse(&v, str, -1), irc_error_success);
+    assert_true(irc_message_view_is(&v, "PRIVMSG"));
+    assert_false(irc_message_view_is(&v, "PRIVMS"));
+    assert_true(irc_message_view_arg_is(&v, 0, "#c"));
+    assert_true(irc_message_view_arg_is(&v, 1, "hi there"));
+    assert_false(irc_message_view_arg_is(&v, 2, "hi there"));
+
+    assert_int_equal(v.prefix.len, strlen("nick!user@host"));
+    assert_ptr_equal(v.prefix.ptr, str + strlen("@time=12:00;msgid=a\\sb :"));
+
+    pos = v.tags.ptr;
+    assert_true(irc_message_view_tag(&v, &pos, &key, &value));
+    assert_int_equal(key.len, 4);
+    assert_memory_equal(key.ptr, "time", 4);
+    assert_int_equal(value.len, 5);
+    assert_memory_equal(value.ptr, "12:00", 5);
+    assert_true(irc_message_view_tag(&v, &pos, &key, &value));
+    assert_memory_equal(value.ptr, "a\\sb", value.len);
+    assert_false(irc_message_view_tag(&v, &pos, &key, &value));
+
+    m = irc_message_view_promote(&v, 0);
+    assert_ptr_not_equal(m, NULL);
+    assert_string_equal(m->prefix, "nick!user@host");
+    assert_string_equal(m->command, "PRIVMSG");
+    assert_int_equal(m->argslen, 2);
+    assert_string_equal(m->args[1], "hi there");
+    assert_int_equal(m->tagslen, 2);
+    assert_string_equal(m->tags[1]->value, "a b");
+
+    irc_message_unref(m);
+}
+
+static void test_message_lazy_tags(void **data)
+{
+    const char *str = "@time=12:00;msgid=a\\sb;flag :nick PRIVMSG #c :hi";
+    irc_message_view_t v;
+    irc_message_t m = NULL;
+    irc_tag_t t = NULL;
+
+    irc_message_view_parse(&v, str, -1);
+    m = irc_message_view_promote(&v, irc_message_flag_lazytags);
+    assert_true(m->flags & irc_message_flag_lazytags);
+    assert_ptr_equal(m->tags, NULL);
+    assert_int_equal(m->tagslen, 0);
+
+    t = irc_message_tag_get(m, "msgid");
+    assert_ptr_not_equal(t, NULL);
+    assert_string_equal(t->value, "a b");
+    assert_int_equal(m->tagslen, 3);
+
+    t = irc_message_tag_get(m, "flag");
+    assert_ptr_not_equal(t, NULL);
+    assert_ptr_equal(t->value, NULL);
+    assert_ptr_equal(irc_message_tag_get(m, "account"), NULL);
+
+    irc_message_unref(m);
+
+    m = irc_message_new();
+    m->flags |= irc_message_flag_lazytags;
+    assert_int_equal(irc_message_parse(m, str, -1), irc_error_success);
+    assert_ptr_equal(m->tags, NULL);
+    t = irc_message_tag_get(m, "time");
+    assert_ptr_not_equal(t, NULL);
+    assert_string_equal(t->value, "12:00");
+
+    irc_message_unref(m);
+}
+
+static void test_message_string_lazy_tags(void **data)
+{
+    irc_message_t m = irc_message_new();
+    const char *expected = "@a=b\\sc;d :prefix COMMAND Arg\r\n";
+    char *actual = NULL;
+    size_t len = 0;
+
+    m->flags |= irc_message_flag_lazytags;
+    irc_message_parse(m, expected, strlen(expected) - 2);
+
+    assert_return_code(irc_message_string(m, &actual, &len),
+                       irc_error_success);
+    assert_string_equal(actual, expected);
+
+    free(actual);
+    irc_message_unref(m);
+}
+
+static void test_message_command_code(void **data)
+{
+    irc_message_t m = NULL;
+
+    assert_int_equal(irc_command_code("PRIVMSG", 7), irc_command_privmsg);
+    assert_int_equal(irc_command_code("NOTICE", 6), irc_command_notice);
+    assert_int_equal(irc_command_code("PING", 4), irc_command_ping);
+    assert_int_equal(irc_command_code("CAP", 3), irc_command_cap);
+    assert_int_equal(irc_command_code("AUTHENTICATE", 12),
+                     irc_command_authenticate);
+    assert_int_equal(irc_command_code("001", 3), 1);
+    assert_int_equal(irc_command_code("433", 3), 433);
+
+    assert_int_equal(irc_command_code("PRIVMSGS", 8), irc_command_unknown);
+    assert_int_equal(irc_command_code("privmsg", 7), irc_command_unknown);
+    assert_int_equal(irc_command_code("4331", 4), irc_command_unknown);
+    assert_int_equal(irc_command_code("43a", 3), irc_command_unknown);
+    assert_int_equal(irc_command_code("X", 1), irc_command_unknown);
+
+    m = irc_message_parse2(":srv 433 * nick :Nickname is already in use", -1);
+    assert_int_equal(m->code, 433);
+    assert_true(irc_message_is_code(m, 433));
+    irc_message_unref(m);
+
+    m = irc_message_parse_packed(":n!u@h JOIN #channel", -1);
+    assert_true(irc_message_is_code(m, irc_command_join));
+    assert_false(irc_message_is_code(m, irc_command_part));
+    irc_message_unref(m);
+
+    m = irc_message_make(NULL, "PONG", "irc.example.org", NULL);
+    assert_true(irc_message_is_code(m, irc_command_pong));
+    irc_message_unref(m);
+}
+
+static void test_message_parse_long_words(void **data)
+{
+    char line[1024] = "CMD";
+    char word[64] = {0};
+    irc_message_view_t v;
+
+    /* words and runs of spaces of all lengths, so that they straddle the
+     * blocks of the vectorised scanner
+     */
+    for (size_t i = 0; i < IRC_MESSAGE_MAXARGS - 1; i++) {
+        size_t end = strlen(line);
+
+        memset(word, 'a' + i, i * 4 + 1);
+        word[i * 4 + 1] = '\0';
+        memset(line + end, ' ', (i % 7) + 1);
+        line[end + (i % 7) + 1] = '\0';
+        strcat(line, word);
+    }
+    strcat(line, "  :final  argument ");
+
+    assert_int_equal(irc_message_view_parse(&v, line, -1), irc_error_success);
+    assert_true(irc_message_view_is(&v, "CMD"));
+    assert_int_equal(v.argslen, IRC_MESSAGE_MAXARGS);
+
+    for (size_t i = 0; i < IRC_MESSAGE_MAXARGS - 1; i++) {
+        assert_int_equal(v.args[i].len, i * 4 + 1);
+        assert_true(v.args[i].ptr[0] == (char)('a' + i));
+        assert_true(v.args[i].ptr[i * 4] == (char)('a' + i));
+    }
+    assert_true(irc_message_view_arg_is(&v, IRC_MESSAGE_MAXARGS - 1,
+                                        "final  argument "));
+}
+
 static void test_message_string(void **data)
 {
     irc_message_t m = irc_message_new();
@@ -190,6 +480,264 @@ static void test_message_string_with_final_param_semicolon(void **data)
     irc_message_unref(m);
 }
 
+static void test_message_serialize_into(void **data)
+{
+    irc_message_t m = irc_message_new();
+    const char *expected =
+        "@a=x\\sy;b :prefix PRIVMSG #channel :A smiley :) and text\r\n";
+    size_t explen = strlen(expected);
+    irc_error_t error = irc_error_internal;
+    char buf[512];
+    struct iovec iov[16];
+    int n = 16;
+    ssize_t len = 0;
+
+    error = irc_message_parse(m, expected, explen - 2);
+    assert_return_code(error, irc_error_success);
+
+    /* too small, nothing is written but the size needed is returned
+     */
+    memset(buf, 'X', sizeof(buf));
+    len = irc_message_serialize_into(m, buf, 10);
+    assert_int_equal(len, explen);
+    assert_int_equal(buf[0], 'X');
+
+    assert_int_equal(irc_message_serialize_into(m, NULL, 0), explen);
+
+    len = irc_message_serialize_into(m, buf, explen);
+    assert_int_equal(len, explen);
+    assert_memory_equal(buf, expected, explen);
+    assert_int_equal(buf[explen], 'X');
+
+    /* a tag without a key has no wire form
+     */
+    free(m->tags[1]->key);
+    m->tags[1]->key = NULL;
+    assert_int_equal(irc_message_serialize_into(m, buf, sizeof(buf)), -1);
+    assert_int_equal(irc_message_serialize_iov(m, iov, &n),
+                     irc_error_argument);
+
+    irc_message_unref(m);
+
+    m = irc_message_new();
+    assert_int_equal(irc_message_serialize_into(m, buf, sizeof(buf)), -1);
+    irc_message_unref(m);
+}
+
+static void test_message_serialize_iov(void **data)
+{
+    char const *lines[] = {
+        "@a=x\\sy\\:\\\\;b :prefix PRIVMSG #channel :A smiley :) and text",
+        ":prefix PRIVMSG #channel ::-)",
+        "PING",
+        "@time=now NOTICE * :hi",
+    };
+    struct iovec iov[64];
+    char buf[512];
+
+    for (size_t i = 0; i < sizeof(lines) / sizeof(lines[0]); i++) {
+        irc_message_t m = irc_message_new();
+        char *expected = NULL;
+        size_t len = 0;
+        size_t off = 0;
+        int n = 1;
+
+        assert_return_code(irc_message_parse(m, lines[i], strlen(lines[i])),
+                           irc_error_success);
+        assert_return_code(irc_message_string(m, &expected, &len),
+                           irc_error_success);
+
+        /* too few entries, the number needed is returned
+         */
+        assert_int_equal(irc_message_serialize_iov(m, iov, &n),
+                         irc_error_argument);
+        assert_true(n > 1);
+
+        n = 64;
+        assert_return_code(irc_message_serialize_iov(m, iov, &n),
+                           irc_error_success);
+        for (int k = 0; k < n; k++) {
+            memcpy(buf + off, iov[k].iov_base, iov[k].iov_len);
+            off += iov[k].iov_len;
+        }
+        assert_int_equal(off, len);
+        assert_memory_equal(buf, expected, len);
+
+        free(expected);
+        irc_message_unref(m);
+    }
+}
+
+#define assert_slice_equal(s, str)                      \
+    do {                                                \
+        assert_int_equal((s).len, strlen(str));         \
+        assert_memory_equal((s).ptr, str, (s).len);     \
+    } while (0)
+
+static void test_message_prefix_views(void **data)
+{
+    irc_message_t m = NULL;
+    irc_slice_t s;
+
+    m = irc_message_parse_packed(":nick!user@host.example PRIVMSG a :b", -1);
+    assert_non_null(m);
+    assert_slice_equal(irc_message_prefix_nick_view(m), "nick");
+    assert_slice_equal(irc_message_prefix_user_view(m), "user");
+    assert_slice_equal(irc_message_prefix_host_view(m), "host.example");
+    assert_true(irc_message_prefix_nick(m, "nick"));
+    assert_false(irc_message_prefix_nick(m, "nickname"));
+    assert_false(irc_message_prefix_nick(m, "nic"));
+    irc_message_unref(m);
+
+    m = irc_message_parse2(":irc.example.net 001 me :Welcome", -1);
+    assert_non_null(m);
+    assert_slice_equal(irc_message_prefix_nick_view(m), "irc.example.net");
+    assert_null(irc_message_prefix_user_view(m).ptr);
+    assert_null(irc_message_prefix_host_view(m).ptr);
+
+    /* a prefix replaced by hand is split again
+     */
+    free(m->prefix);
+    m->prefix = strdup("other@host");
+    assert_slice_equal(irc_message_prefix_nick_view(m), "other");
+    assert_null(irc_message_prefix_user_view(m).ptr);
+    assert_slice_equal(irc_message_prefix_host_view(m), "host");
+    irc_message_unref(m);
+
+    m = irc_message_parse_packed("PING :x", -1);
+    s = irc_message_prefix_nick_view(m);
+    assert_null(s.ptr);
+    assert_false(irc_message_prefix_nick(m, "x"));
+    irc_message_unref(m);
+}
+
+static void test_message_tag_index(void **data)
+{
+    char const *line =
+        "@foo=1;msgid=abc;time=2020-01-01T00:00:00Z;msgid=dup;x/label=no"
+        " :n!u@h PRIVMSG #c :hi";
+    irc_message_t msgs[3] = {0};
+    irc_message_view_t v;
+
+    msgs[0] = irc_message_parse2(line, -1);
+    msgs[1] = irc_message_parse_packed(line, -1);
+    assert_return_code(irc_message_view_parse(&v, line, -1),
+                       irc_error_success);
+    msgs[2] = irc_message_view_promote(&v, irc_message_flag_lazytags);
+
+    for (size_t i = 0; i < 3; i++) {
+        irc_message_t m = msgs[i];
+        irc_tag_t t = NULL;
+
+        assert_non_null(m);
+
+        t = irc_message_tag_known(m, irc_tag_key_msgid);
+        assert_non_null(t);
+        assert_string_equal(t->value, "abc");
+        assert_ptr_equal(irc_message_tag_get(m, "msgid"), t);
+
+        t = irc_message_tag_get(m, "time");
+        assert_non_null(t);
+        assert_string_equal(t->value, "2020-01-01T00:00:00Z");
+
+        t = irc_message_tag_get(m, "foo");
+        assert_non_null(t);
+        assert_string_equal(t->value, "1");
+
+        assert_null(irc_message_tag_get(m, "label"));
+        assert_null(irc_message_tag_known(m, irc_tag_key_account));
+        assert_non_null(irc_message_tag_get(m, "x/label"));
+
+        irc_message_unref(m);
+    }
+
+    /* tags replaced by hand, likely at the very same address
+     */
+    msgs[0] = irc_message_parse2("@msgid=abc;time=now PING :x", -1);
+    assert_non_null(msgs[0]);
+    assert_non_null(irc_message_tag_known(msgs[0], irc_tag_key_msgid));
+    for (size_t i = 0; i < msgs[0]->tagslen; i++) {
+        irc_tag_free(msgs[0]->tags[i]);
+    }
+    free(msgs[0]->tags);
+    msgs[0]->tags = calloc(2, sizeof(irc_tag_t));
+    msgs[0]->tags[0] = irc_tag_make("time", "later");
+    msgs[0]->tags[1] = irc_tag_make("msgid", "def");
+    assert_string_equal(
+        irc_message_tag_known(msgs[0], irc_tag_key_msgid)->value, "def");
+    assert_string_equal(irc_message_tag_get(msgs[0], "time")->value, "later");
+    irc_message_unref(msgs[0]);
+
+    assert_int_equal(irc_tag_key("batch", 5), irc_tag_key_batch);
+    assert_int_equal(irc_tag_key("batc", 4), irc_tag_key_unknown);
+}
+
+static void test_message_privmsg(void **data)
+{
+    irc_message_t m = NULL;
+    char longer[1024];
+
+    m = irc_message_privmsg("me", "#chan", "%d %s", 42, "things");
+    assert_non_null(m);
+    assert_string_equal(m->prefix, "me");
+    assert_int_equal(m->code, irc_command_privmsg);
+    assert_string_equal(m->args[0], "#chan");
+    assert_string_equal(m->args[1], "42 things");
+    irc_message_unref(m);
+
+    memset(longer, 'a', sizeof(longer) - 1);
+    longer[sizeof(longer) - 1] = '\0';
+    m = irc_message_privmsg(NULL, "#chan", "%s!", longer);
+    assert_non_null(m);
+    assert_int_equal(strlen(m->args[1]), sizeof(longer));
+    irc_message_unref(m);
+}
+
+static void lazytags_handler(irc_t i, irc_message_t m, void *arg)
+{
+    irc_tag_t tag = NULL;
+
+    *(unsigned *)arg = m->flags;
+
+    /* decoded on demand, either way the handler sees the same tags
+     */
+    tag = irc_message_tag_get(m, "msgid");
+    assert_non_null(tag);
+    assert_string_equal(tag->value, "a b");
+}
+
+static void test_message_irc_lazytags(void **data)
+{
+    irc_t irc = irc_new();
+    bool lazy = true;
+    unsigned flags = 0;
+    char const *line = "@msgid=a\\sb :a PRIVMSG #b :hello\r\n";
+
+    assert_non_null(irc);
+    irc_setopt(irc, ircopt_nick, "me");
+    irc_handler_add(irc, "PRIVMSG", lazytags_handler, &flags);
+
+    assert_return_code(irc_getopt(irc, ircopt_lazytags, &lazy),
+                       irc_error_success);
+    assert_false(lazy);
+
+    irc_feed(irc, line, strlen(line));
+    assert_return_code(irc_think(irc), irc_error_success);
+    assert_false(flags & irc_message_flag_lazytags);
+
+    assert_return_code(irc_setopt(irc, ircopt_lazytags, true),
+                       irc_error_success);
+    assert_return_code(irc_getopt(irc, ircopt_lazytags, &lazy),
+                       irc_error_success);
+    assert_true(lazy);
+
+    irc_feed(irc, line, strlen(line));
+    assert_return_code(irc_think(irc), irc_error_success);
+    assert_true(flags & irc_message_flag_lazytags);
+
+    irc_free(irc);
+}
+
 int main(int ac, char **av)
 {
     const struct CMUnitTest tests[] = {
@@ -199,9 +747,24 @@ int main(int ac, char **av)
         cmocka_unit_test(test_message_parse_with_parameters),
         cmocka_unit_test(test_message_parse_with_single_tag),
         cmocka_unit_test(test_message_parse_with_multiple_tag),
+        cmocka_unit_test(test_message_parse_unterminated),
+        cmocka_unit_test(test_message_parse_packed),
+        cmocka_unit_test(test_message_parse_batch),
+        cmocka_unit_test(test_message_parse_maxargs),
+        cmocka_unit_test(test_message_view),
+        cmocka_unit_test(test_message_lazy_tags),
+        cmocka_unit_test(test_message_command_code),
+        cmocka_unit_test(test_message_parse_long_words),
         cmocka_unit_test(test_message_string),
+        cmocka_unit_test(test_message_string_lazy_tags),
         cmocka_unit_test(test_message_string_with_semicolon),
         cmocka_unit_test(test_message_string_with_final_param_semicolon),
+        cmocka_unit_test(test_message_serialize_into),
+        cmocka_unit_test(test_message_serialize_iov),
+        cmocka_unit_test(test_message_prefix_views),
+        cmocka_unit_test(test_message_tag_index),
+        cmocka_unit_test(test_message_privmsg),
+        cmocka_unit_test(test_message_irc_lazytags),
     };
 
     return cmocka_run_group_tests(tests, NULL, NULL);
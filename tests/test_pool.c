@@ -0,0 +1,240 @@
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <cmocka.h>
+#include <stdint.h>
+
+#include <irc/pool.h>
+#include <irc/message.h>
+#include <irc/irc.h>
+
+static int setup(void **data)
+{
+    irc_pool_t p = irc_pool_new(4);
+    if (p == NULL) {
+        return -1;
+    }
+
+    *data = p;
+
+    return 0;
+}
+
+static int teardown(void **data)
+{
+    irc_pool_free(*data);
+
+    return 0;
+}
+
+static void test_pool_recycle(void **data)
+{
+    irc_pool_t p = *data;
+    irc_pool_stats_t st;
+    void *a = NULL, *b = NULL;
+
+    a = irc_pool_alloc(p, 100);
+    assert_non_null(a);
+    memset(a, 'a', 100);
+    assert_ptr_equal(irc_pool_owner(a), p);
+    irc_pool_release(a);
+
+    /* same size class, so the block comes straight back
+     */
+    b = irc_pool_alloc(p, 120);
+    assert_ptr_equal(a, b);
+    irc_pool_release(b);
+
+    assert_return_code(irc_pool_stats(p, &st), irc_error_success);
+    assert_int_equal(st.hits, 1);
+    assert_int_equal(st.misses, 1);
+    assert_int_equal(st.recycled, 2);
+    assert_int_equal(st.cached, 1);
+    assert_int_equal(st.used, 0);
+}
+
+static void test_pool_cap(void **data)
+{
+    irc_pool_t p = *data;
+    irc_pool_stats_t st;
+    void *blocks[8] = {0};
+
+    for (size_t i = 0; i < 8; i++) {
+        blocks[i] = irc_pool_alloc(p, 64);
+        assert_non_null(blocks[i]);
+    }
+    for (size_t i = 0; i < 8; i++) {
+        irc_pool_release(blocks[i]);
+    }
+
+    irc_pool_stats(p, &st);
+    assert_int_equal(st.cached, 4);
+    assert_int_equal(st.dropped, 4);
+
+    irc_pool_set_cap(p, 1);
+    irc_pool_stats(p, &st);
+    assert_int_equal(st.cached, 1);
+
+    /* too large for any size class, never kept
+     */
+    blocks[0] = irc_pool_alloc(p, 1 << 20);
+    assert_non_null(blocks[0]);
+    irc_pool_release(blocks[0]);
+    irc_pool_stats(p, &st);
+    assert_int_equal(st.cached, 1);
+    assert_int_equal(st.dropped, 5);
+}
+
+static void test_pool_message(void **data)
+{
+    irc_pool_t p = *data;
+    irc_pool_stats_t st;
+    irc_message_view_t v;
+    irc_message_t m = NULL;
+    irc_tag_t t = NULL;
+    char const *line = "@time=now;msgid=1 :nick!user@host PRIVMSG #chan :hi";
+
+    assert_return_code(irc_message_view_parse(&v, line, strlen(line)),
+                       irc_error_success);
+
+    m = irc_message_view_promote_pool(&v, irc_message_flag_lazytags, p);
+    assert_non_null(m);
+    assert_true(m->flags & irc_message_flag_pooled);
+    assert_string_equal(m->command, "PRIVMSG");
+    assert_string_equal(m->args[1], "hi");
+
+    t = irc_message_tag_get(m, "msgid");
+    assert_non_null(t);
+    assert_string_equal(t->value, "1");
+
+    irc_pool_stats(p, &st);
+    assert_int_equal(st.used, 2);
+
+    irc_message_unref(m);
+
+    irc_pool_stats(p, &st);
+    assert_int_equal(st.used, 0);
+    assert_int_equal(st.cached, 2);
+}
+
+static irc_message_t make(irc_pool_t p, char const *prefix,
+                          char const *cmd, ...)
+{
+    irc_message_t m = NULL;
+    va_list lst;
+
+    va_start(lst, cmd);
+    m = irc_message_makev_pool(p, prefix, cmd, lst);
+    va_end(lst);
+
+    return m;
+}
+
+static void test_pool_make(void **data)
+{
+    irc_pool_t p = *data;
+    irc_message_t m = NULL;
+    char *str = NULL;
+    size_t len = 0;
+
+    m = make(p, "nick", "JOIN", "#chan", NULL);
+    assert_non_null(m);
+    assert_int_equal(m->code, irc_command_join);
+    assert_return_code(irc_message_string(m, &str, &len), irc_error_success);
+    assert_string_equal(str, ":nick JOIN #chan\r\n");
+    free(str);
+    irc_message_unref(m);
+
+    /* more arguments than a view holds, still works
+     */
+    m = make(p, NULL, "X", "1", "2", "3", "4", "5", "6", "7", "8", "9",
+             "10", "11", "12", "13", "14", "15", "16", NULL);
+    assert_non_null(m);
+    assert_int_equal(m->argslen, 16);
+    assert_false(m->flags & irc_message_flag_pooled);
+    irc_message_unref(m);
+}
+
+static void test_pool_outlives(void **data)
+{
+    irc_pool_t p = irc_pool_new(4);
+    irc_message_t m = NULL;
+
+    m = irc_message_parse_packed(":a PING :b", -1);
+    irc_message_unref(m);
+
+    m = make(p, NULL, "PING", "b", NULL);
+    assert_non_null(m);
+
+    /* the pool only goes away once its last block has come back
+     */
+    irc_pool_free(p);
+    assert_string_equal(m->args[0], "b");
+    irc_message_unref(m);
+}
+
+static void pool_handler(irc_t i, irc_message_t m, void *arg)
+{
+    *(unsigned *)arg = m->flags;
+}
+
+static void test_pool_irc(void **data)
+{
+    irc_t irc = irc_new();
+    irc_pool_t p = NULL;
+    irc_pool_stats_t stats;
+    unsigned flags = 0;
+    char const *line = ":a PRIVMSG #b :hello\r\n";
+
+    assert_non_null(irc);
+    irc_setopt(irc, ircopt_nick, "me");
+    irc_handler_add(irc, "PRIVMSG", pool_handler, &flags);
+
+    assert_return_code(irc_getopt(irc, ircopt_pool, &p), irc_error_success);
+    assert_null(p);
+
+    assert_return_code(irc_setopt(irc, ircopt_pool, 64), irc_error_success);
+    assert_return_code(irc_getopt(irc, ircopt_pool, &p), irc_error_success);
+    assert_non_null(p);
+
+    irc_feed(irc, line, strlen(line));
+    assert_return_code(irc_think(irc), irc_error_success);
+    assert_true(flags & irc_message_flag_pooled);
+
+    /* what irc_think() queued came from the pool as well
+     */
+    assert_return_code(irc_pool_stats(p, &stats), irc_error_success);
+    assert_true(stats.used > 0);
+    irc_reset(irc);
+    assert_return_code(irc_pool_stats(p, &stats), irc_error_success);
+    assert_int_equal(stats.used, 0);
+    assert_true(stats.cached > 0);
+
+    assert_return_code(irc_setopt(irc, ircopt_pool, 0), irc_error_success);
+    assert_return_code(irc_getopt(irc, ircopt_pool, &p), irc_error_success);
+    assert_null(p);
+
+    flags = 0;
+    irc_feed(irc, line, strlen(line));
+    assert_return_code(irc_think(irc), irc_error_success);
+    assert_false(flags & irc_message_flag_pooled);
+
+    irc_free(irc);
+}
+
+int main(int ac, char **av)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_pool_recycle, setup, teardown),
+        cmocka_unit_test_setup_teardown(test_pool_cap, setup, teardown),
+        cmocka_unit_test_setup_teardown(test_pool_message, setup, teardown),
+        cmocka_unit_test_setup_teardown(test_pool_make, setup, teardown),
+        cmocka_unit_test(test_pool_outlives),
+        cmocka_unit_test(test_pool_irc),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,437 @@
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <cmocka.h>
+#include <stdint.h>
+
+#include <irc/queue.h>
+#include <irc/irc.h>
+#include <irc/message.h>
+
+#include <pthread.h>
+#include <stdio.h>
+
+#define ITEM(n) ((void *)(uintptr_t)(n))
+
+static int setup(void **data)
+{
+    irc_queue_t q = irc_queue_new();
+    if (q == NULL) {
+        return -1;
+    }
+
+    *data = q;
+
+    return 0;
+}
+
+static int teardown(void **data)
+{
+    irc_queue_free(*data);
+
+    return 0;
+}
+
+static void test_queue_fifo(void **data)
+{
+    irc_queue_t q = *data;
+
+    assert_null(irc_queue_pop(q));
+
+    for (uintptr_t i = 1; i <= 100; i++) {
+        assert_return_code(irc_queue_push(q, ITEM(i)), irc_error_success);
+    }
+    assert_int_equal(irc_queue_len(q), 100);
+
+    for (uintptr_t i = 1; i <= 100; i++) {
+        assert_ptr_equal(irc_queue_pop(q), ITEM(i));
+    }
+    assert_null(irc_queue_pop(q));
+    assert_int_equal(irc_queue_len(q), 0);
+}
+
+static void test_queue_wrap(void **data)
+{
+    irc_queue_t q = *data;
+    uintptr_t in = 1, out = 1;
+
+    /* keep head moving around the ring, and grow it while wrapped
+     */
+    for (size_t round = 0; round < 50; round++) {
+        for (size_t k = 0; k < 7 + round; k++) {
+            irc_queue_push(q, ITEM(in++));
+        }
+        for (size_t k = 0; k < 5 + round / 2; k++) {
+            assert_ptr_equal(irc_queue_pop(q), ITEM(out++));
+        }
+    }
+
+    while (irc_queue_len(q) > 0) {
+        assert_ptr_equal(irc_queue_pop(q), ITEM(out++));
+    }
+    assert_int_equal(in, out);
+}
+
+static void test_queue_pop_n(void **data)
+{
+    irc_queue_t q = *data;
+    void *out[32] = {0};
+    uintptr_t next = 1;
+
+    for (uintptr_t i = 1; i <= 12; i++) {
+        irc_queue_push(q, ITEM(i));
+    }
+    assert_int_equal(irc_queue_pop_n(q, out, 10), 10);
+    for (size_t i = 0; i < 10; i++) {
+        assert_ptr_equal(out[i], ITEM(next++));
+    }
+
+    /* now the items wrap around the end of the ring
+     */
+    for (uintptr_t i = 13; i <= 24; i++) {
+        irc_queue_push(q, ITEM(i));
+    }
+    assert_int_equal(irc_queue_pop_n(q, out, 32), 14);
+    for (size_t i = 0; i < 14; i++) {
+        assert_ptr_equal(out[i], ITEM(next++));
+    }
+    assert_int_equal(irc_queue_pop_n(q, out, 32), 0);
+}
+
+static void test_queue_clear(void **data)
+{
+    irc_queue_t q = *data;
+
+    for (size_t i = 0; i < 20; i++) {
+        irc_queue_push(q, strdup("item"));
+    }
+    irc_queue_clear(q, free);
+    assert_int_equal(irc_queue_len(q), 0);
+}
+
+#define PRODUCERS  4
+#define PRODUCED   5000
+
+typedef struct {
+    irc_t irc;
+    size_t id;
+} producer_t;
+
+static void *producer(void *arg)
+{
+    producer_t *p = arg;
+    char id[16], seq[16];
+
+    snprintf(id, sizeof(id), "%zu", p->id);
+    for (size_t i = 0; i < PRODUCED; i++) {
+        snprintf(seq, sizeof(seq), "%zu", i);
+        if (IRC_FAILED(irc_queue_command(p->irc, "X", id, seq, NULL))) {
+            return (void *)1;
+        }
+    }
+
+    return NULL;
+}
+
+static void test_queue_irc_threads(void **data)
+{
+    irc_t irc = irc_new();
+    pthread_t threads[PRODUCERS];
+    producer_t producers[PRODUCERS];
+    size_t next[PRODUCERS] = {0};
+
+    assert_non_null(irc);
+    irc_setopt(irc, ircopt_nick, "me");
+
+    for (size_t k = 0; k < PRODUCERS; k++) {
+        producers[k].irc = irc;
+        producers[k].id = k;
+        pthread_create(threads + k, NULL, producer, producers + k);
+    }
+
+    /* every producer's lines come out in the order it queued them, even
+     * when they spill past the lock free ring
+     */
+    for (size_t got = 0; got < PRODUCERS * PRODUCED; got++) {
+        irc_message_t m = NULL;
+        char *line = NULL;
+        size_t len = 0;
+        size_t id = 0;
+
+        assert_return_code(irc_pop_wait(irc, &line, &len, 5000),
+                           irc_error_success);
+        m = irc_message_parse2(line, len - 2);
+        assert_non_null(m);
+        assert_int_equal(m->argslen, 2);
+
+        id = strtoul(m->args[0], NULL, 10);
+        assert_true(id < PRODUCERS);
+        assert_int_equal(strtoul(m->args[1], NULL, 10), next[id]);
+        ++next[id];
+
+        irc_message_unref(m);
+        free(line);
+    }
+
+    for (size_t k = 0; k < PRODUCERS; k++) {
+        void *ret = NULL;
+
+        pthread_join(threads[k], &ret);
+        assert_null(ret);
+    }
+
+    assert_int_equal(irc_pop_wait(irc, NULL, NULL, 0), irc_error_nodata);
+    irc_free(irc);
+}
+
+static void *resetter(void *arg)
+{
+    irc_t irc = arg;
+
+    for (int k = 0; k < 2000; k++) {
+        irc_queue_command(irc, "PRIVMSG", "#a", "hi", NULL);
+        if (k % 100 == 0) {
+            irc_reset(irc);
+        }
+    }
+
+    return NULL;
+}
+
+static void queue_irc_reset_threads(bool flood)
+{
+    irc_t irc = irc_new();
+    pthread_t thread;
+    char *line = NULL;
+    size_t len = 0;
+    size_t got = 0;
+
+    assert_non_null(irc);
+
+    /* a line held back by flood control may vanish under irc_pop_wait()
+     * while it sleeps on it
+     */
+    if (flood) {
+        assert_return_code(irc_setopt(irc, ircopt_flood, 5, 2, 0),
+                           irc_error_success);
+    }
+
+    /* resetting while another thread pops must not leave two consumers
+     * on the queue
+     */
+    pthread_create(&thread, NULL, resetter, irc);
+    while (irc_pop_wait(irc, &line, &len, 200) == irc_error_success) {
+        assert_string_equal(line, "PRIVMSG #a hi\r\n");
+        free(line);
+        ++got;
+    }
+    pthread_join(thread, NULL);
+
+    assert_true(got <= 2000);
+    irc_free(irc);
+}
+
+static void test_queue_irc_reset_threads(void **data)
+{
+    queue_irc_reset_threads(false);
+    queue_irc_reset_threads(true);
+}
+
+static void pop_expect(irc_t irc, char const *expect)
+{
+    char *line = NULL;
+    size_t len = 0;
+
+    assert_return_code(irc_pop(irc, &line, &len), irc_error_success);
+    assert_string_equal(line, expect);
+    free(line);
+}
+
+static void test_queue_irc_lanes(void **data)
+{
+    irc_t irc = irc_new();
+    unsigned w = 0;
+
+    assert_non_null(irc);
+
+    irc_queue_command_lane(irc, irc_lane_bulk, "PRIVMSG", "#a", "b1", NULL);
+    irc_queue_command_lane(irc, irc_lane_bulk, "PRIVMSG", "#a", "b2", NULL);
+    irc_queue_command(irc, "PRIVMSG", "#a", "i1", NULL);
+    irc_queue_command(irc, "PRIVMSG", "#a", "i2", NULL);
+    irc_queue_command(irc, "PONG", "tok", NULL);
+
+    /* strict by default, control first
+     */
+    pop_expect(irc, "PONG tok\r\n");
+    pop_expect(irc, "PRIVMSG #a i1\r\n");
+    pop_expect(irc, "PRIVMSG #a i2\r\n");
+    pop_expect(irc, "PRIVMSG #a b1\r\n");
+    pop_expect(irc, "PRIVMSG #a b2\r\n");
+    assert_int_equal(irc_pop(irc, NULL, NULL), irc_error_nodata);
+
+    assert_int_equal(irc_setopt(irc, ircopt_lane_weight, irc_lane_control, 1),
+                     irc_error_argument);
+    assert_return_code(irc_setopt(irc, ircopt_lane_weight,
+                                  irc_lane_interactive, 2),
+                       irc_error_success);
+    assert_return_code(irc_setopt(irc, ircopt_lane_weight, irc_lane_bulk, 1),
+                       irc_error_success);
+    assert_return_code(irc_getopt(irc, ircopt_lane_weight, irc_lane_bulk, &w),
+                       irc_error_success);
+    assert_int_equal(w, 1);
+
+    for (int k = 0; k < 4; k++) {
+        irc_queue_command_lane(irc, irc_lane_bulk, "PRIVMSG", "#a", "b", NULL);
+        irc_queue_command(irc, "PRIVMSG", "#a", "i", NULL);
+    }
+
+    /* two interactive for every bulk message, until one lane runs dry
+     */
+    pop_expect(irc, "PRIVMSG #a i\r\n");
+    pop_expect(irc, "PRIVMSG #a i\r\n");
+    pop_expect(irc, "PRIVMSG #a b\r\n");
+    irc_queue_command(irc, "QUIT", NULL);
+    pop_expect(irc, "QUIT \r\n");
+    pop_expect(irc, "PRIVMSG #a i\r\n");
+    pop_expect(irc, "PRIVMSG #a i\r\n");
+    pop_expect(irc, "PRIVMSG #a b\r\n");
+    pop_expect(irc, "PRIVMSG #a b\r\n");
+    pop_expect(irc, "PRIVMSG #a b\r\n");
+    assert_int_equal(irc_pop(irc, NULL, NULL), irc_error_nodata);
+
+    irc_free(irc);
+}
+
+static void test_queue_irc_coalesce(void **data)
+{
+    irc_t irc = irc_new();
+    char const *isupport =
+        ":srv 005 me TARGMAX=PRIVMSG:4,JOIN:2 MODES=2 :are supported\r\n";
+    char chan[32];
+    char *line = NULL;
+    size_t len = 0, lines = 0, seen = 0;
+
+    assert_non_null(irc);
+    irc_setopt(irc, ircopt_nick, "me");
+
+    for (int k = 0; k < 800; k++) {
+        snprintf(chan, sizeof(chan), "#channel%03d", k);
+        irc_join(irc, chan);
+    }
+
+    /* every channel once, in order, and no line too long
+     */
+    while (irc_pop(irc, &line, &len) == irc_error_success) {
+        char *tok = NULL, *save = NULL;
+
+        assert_true(len <= 512);
+        assert_memory_equal(line, ":me JOIN #", 10);
+        line[len - 2] = '\0';
+
+        for (tok = strtok_r(line + 9, ",", &save); tok != NULL;
+             tok = strtok_r(NULL, ",", &save)) {
+            snprintf(chan, sizeof(chan), "#channel%03zu", seen++);
+            assert_string_equal(tok, chan);
+        }
+
+        free(line);
+        ++lines;
+    }
+    assert_int_equal(seen, 800);
+    assert_true(lines <= 800 / 10);
+
+    /* limits from ISUPPORT, and nothing merges across other lines
+     */
+    irc_feed(irc, isupport, strlen(isupport));
+    irc_think(irc);
+
+    /* USER carries our hostname
+     */
+    assert_return_code(irc_pop(irc, &line, &len), irc_error_success);
+    assert_memory_equal(line, ":me USER me ", 12);
+    free(line);
+    pop_expect(irc, ":me NICK me\r\n");
+
+    irc_join(irc, "#a");
+    irc_join(irc, "#b");
+    irc_join(irc, "#c");
+    irc_queue_command(irc, "PRIVMSG", "#a", "hi", NULL);
+    irc_queue_command(irc, "PART", "#a", NULL);
+    irc_queue_command(irc, "PART", "#b", NULL);
+    irc_queue_command(irc, "MODE", "#a", "+o", "x", NULL);
+    irc_queue_command(irc, "MODE", "#a", "+v", "y", NULL);
+    irc_queue_command(irc, "MODE", "#a", "-o", "z", NULL);
+    irc_queue_command(irc, "MODE", "#b", "+o", "w", NULL);
+    irc_queue_command(irc, "MODE", "#b", "+b", "*!*@*", NULL);
+
+    pop_expect(irc, ":me JOIN #a,#b\r\n");
+    pop_expect(irc, ":me JOIN #c\r\n");
+    pop_expect(irc, ":me PRIVMSG #a hi\r\n");
+    pop_expect(irc, ":me PART #a,#b\r\n");
+    pop_expect(irc, ":me MODE #a +ov x y\r\n");
+    pop_expect(irc, ":me MODE #a -o z\r\n");
+    pop_expect(irc, ":me MODE #b +o w\r\n");
+    pop_expect(irc, ":me MODE #b +b *!*@*\r\n");
+
+    /* more than a message can carry, and no limit at all
+     */
+    for (int round = 0; round < 2; round++) {
+        char const *modes = (round == 0 ?
+            ":srv 005 me MODES=20 :are supported\r\n" :
+            ":srv 005 me MODES :are supported\r\n");
+        char nick[16];
+        size_t nicks = 0;
+
+        irc_feed(irc, modes, strlen(modes));
+        irc_think(irc);
+
+        for (int k = 0; k < 16; k++) {
+            snprintf(nick, sizeof(nick), "n%d", k);
+            irc_queue_command(irc, "MODE", "#c", "+o", nick, NULL);
+        }
+
+        while (irc_pop(irc, &line, &len) == irc_error_success) {
+            irc_message_t m = irc_message_parse2(line, len - 2);
+
+            assert_non_null(m);
+            assert_string_equal(m->command, "MODE");
+            for (size_t idx = 2; idx < m->argslen; idx++) {
+                snprintf(nick, sizeof(nick), "n%zu", nicks++);
+                assert_string_equal(m->args[idx], nick);
+            }
+            assert_int_equal(strlen(m->args[1]), m->argslen - 1);
+
+            irc_message_unref(m);
+            free(line);
+        }
+        assert_int_equal(nicks, 16);
+    }
+
+    irc_setopt(irc, ircopt_coalesce, false);
+    irc_join(irc, "#d");
+    irc_join(irc, "#e");
+    pop_expect(irc, ":me JOIN #d\r\n");
+    pop_expect(irc, ":me JOIN #e\r\n");
+    assert_int_equal(irc_pop(irc, NULL, NULL), irc_error_nodata);
+
+    irc_free(irc);
+}
+
+int main(int ac, char **av)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_queue_fifo, setup, teardown),
+        cmocka_unit_test_setup_teardown(test_queue_wrap, setup, teardown),
+        cmocka_unit_test_setup_teardown(test_queue_pop_n, setup, teardown),
+        cmocka_unit_test_setup_teardown(test_queue_clear, setup, teardown),
+        cmocka_unit_test(test_queue_irc_threads),
+        cmocka_unit_test(test_queue_irc_reset_threads),
+        cmocka_unit_test(test_queue_irc_lanes),
+        cmocka_unit_test(test_queue_irc_coalesce),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
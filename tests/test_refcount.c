@@ -0,0 +1,138 @@
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <cmocka.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include <irc/message.h>
+#include <irc/config.h>
+
+/* These are mostly useful when built with -DIRC_TSAN=ON, where
+ * ThreadSanitizer complains about any unsynchronised access.
+ */
+#define THREADS    8
+#define ROUNDS     10000
+
+static void *message_worker(void *arg)
+{
+    irc_message_t m = arg;
+
+    for (size_t i = 0; i < ROUNDS; i++) {
+        irc_tag_t t = NULL;
+        char buf[512];
+
+        irc_message_ref(m);
+
+        t = irc_message_tag_get(m, "msgid");
+        if (t == NULL || strcmp(t->value, "abc") != 0) {
+            irc_message_unref(m);
+            return (void *)1;
+        }
+        if (irc_message_serialize_into(m, buf, sizeof(buf)) <= 0) {
+            irc_message_unref(m);
+            return (void *)1;
+        }
+
+        irc_message_unref(m);
+    }
+
+    /* drop the reference the test handed us
+     */
+    irc_message_unref(m);
+
+    return NULL;
+}
+
+static void run_message_workers(irc_message_t m)
+{
+    pthread_t threads[THREADS];
+
+    for (size_t i = 0; i < THREADS; i++) {
+        irc_message_ref(m);
+        assert_int_equal(pthread_create(threads + i, NULL,
+                                         message_worker, m), 0);
+    }
+    /* the workers now hold the only references
+     */
+    irc_message_unref(m);
+
+    for (size_t i = 0; i < THREADS; i++) {
+        void *ret = NULL;
+
+        pthread_join(threads[i], &ret);
+        assert_null(ret);
+    }
+}
+
+static void test_refcount_message(void **data)
+{
+    char const *line = "@msgid=abc;time=now :n!u@h PRIVMSG #chan :hello";
+    irc_message_view_t v;
+    irc_pool_t pool = irc_pool_new(16);
+
+    run_message_workers(irc_message_parse2(line, -1));
+    run_message_workers(irc_message_parse_packed(line, -1));
+
+    assert_return_code(irc_message_view_parse(&v, line, -1),
+                       irc_error_success);
+    run_message_workers(irc_message_view_promote(&v,
+                                                 irc_message_flag_lazytags));
+    run_message_workers(irc_message_view_promote_pool(
+                            &v, irc_message_flag_lazytags, pool));
+
+    irc_pool_free(pool);
+}
+
+static void *network_worker(void *arg)
+{
+    irc_config_network_t n = arg;
+
+    for (size_t i = 0; i < ROUNDS; i++) {
+        irc_config_network_ref(n);
+        if (strcmp(irc_config_network_nickserv(n), "nickserv") != 0) {
+            irc_config_network_unref(n);
+            return (void *)1;
+        }
+        irc_config_network_unref(n);
+    }
+
+    irc_config_network_unref(n);
+
+    return NULL;
+}
+
+static void test_refcount_network(void **data)
+{
+    irc_config_network_t n = irc_config_network_new("net");
+    pthread_t threads[THREADS];
+
+    assert_non_null(n);
+
+    for (size_t i = 0; i < THREADS; i++) {
+        irc_config_network_ref(n);
+        assert_int_equal(pthread_create(threads + i, NULL,
+                                         network_worker, n), 0);
+    }
+    irc_config_network_unref(n);
+
+    for (size_t i = 0; i < THREADS; i++) {
+        void *ret = NULL;
+
+        pthread_join(threads[i], &ret);
+        assert_null(ret);
+    }
+}
+
+int main(int ac, char **av)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_refcount_message),
+        cmocka_unit_test(test_refcount_network),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
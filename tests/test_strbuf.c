@@ -218,6 +218,190 @@ static void test_strbuf_getstr_partial(void **data)
     strbuf_free(b);
 }
 
+static void test_strbuf_getstr_interleaved(void **data)
+{
+    strbuf_t b = strbuf_new();
+    char *line = NULL;
+    size_t linelen = 0;
+
+    strbuf_append(b, "first\r\nsecond\r\nthi", -1);
+
+    assert_true(strbuf_getstr(b, &line, &linelen, "\r\n") == 0);
+    assert_true(strcmp(line, "first\r\n") == 0);
+    free(line);
+
+    assert_true(strbuf_getstr(b, &line, &linelen, "\r\n") == 0);
+    assert_true(strcmp(line, "second\r\n") == 0);
+    free(line);
+
+    /* appending now reclaims the consumed head
+     */
+    strbuf_append(b, "rd\r\nfou", -1);
+    assert_true(strbuf_len(b) == strlen("third\r\nfou"));
+    assert_true(strbuf_getc(b) == 't');
+
+    assert_true(strbuf_getstr(b, &line, &linelen, "\r\n") == 0);
+    assert_true(strcmp(line, "third\r\n") == 0);
+    free(line);
+
+    assert_true(strbuf_getstr(b, &line, &linelen, "\r\n") < 0);
+    strbuf_append(b, "rth\r\n", -1);
+
+    assert_true(strbuf_getstr(b, &line, &linelen, "\r\n") == 0);
+    assert_true(strcmp(line, "fourth\r\n") == 0);
+    assert_true(linelen == strlen("fourth\r\n"));
+    free(line);
+
+    assert_true(strbuf_len(b) == 0);
+    strbuf_free(b);
+}
+
+static void test_strbuf_peekstr(void **data)
+{
+    strbuf_t b = strbuf_new();
+    char const *line = NULL;
+    size_t linelen = 0;
+
+    strbuf_append(b, "test\r\nfoo", -1);
+
+    assert_true(strbuf_peekstr(b, &line, &linelen, "\r\n") == 0);
+    assert_true(linelen == strlen("test\r\n"));
+    assert_true(strncmp(line, "test\r\n", linelen) == 0);
+
+    /* peeking does not consume anything
+     */
+    assert_true(strbuf_len(b) == strlen("test\r\nfoo"));
+    assert_true(strbuf_delete(b, linelen) == 0);
+    assert_true(strbuf_len(b) == strlen("foo"));
+
+    assert_true(strbuf_peekstr(b, &line, &linelen, "\r\n") < 0);
+
+    strbuf_free(b);
+}
+
+static void test_strbuf_getstr_split_delimiter(void **data)
+{
+    strbuf_t b = strbuf_new();
+    char *line = NULL;
+    size_t linelen = 0;
+
+    strbuf_append(b, "a lone \r and \n do not count\r", -1);
+    assert_true(strbuf_getstr(b, &line, &linelen, "\r\n") < 0);
+
+    strbuf_append(b, "\n", -1);
+    assert_true(strbuf_getstr(b, &line, &linelen, "\r\n") == 0);
+    assert_true(strcmp(line, "a lone \r and \n do not count\r\n") == 0);
+
+    free(line);
+    strbuf_free(b);
+}
+
+static void test_strbuf_getstr_long_lines(void **data)
+{
+    strbuf_t b = strbuf_new();
+    char buffer[200] = {0};
+    char *line = NULL;
+    size_t linelen = 0;
+
+    /* move the delimiter across every position of a vector block
+     */
+    for (size_t i = 0; i < 100; i++) {
+        memset(buffer, '\r', i);
+        memcpy(buffer + i, "\r\n", 3);
+
+        strbuf_append(b, buffer, -1);
+        assert_true(strbuf_getstr(b, &line, &linelen, "\r\n") == 0);
+        assert_true(linelen == i + 2);
+        assert_true(strbuf_len(b) == 0);
+        free(line);
+    }
+
+    strbuf_free(b);
+}
+
+static void test_strbuf_append_bytewise(void **data)
+{
+    strbuf_t b = strbuf_new();
+    char *str = NULL;
+
+    assert_true(strbuf_reserve(b, 16) == 0);
+    assert_true(strbuf_len(b) == 0);
+
+    for (size_t i = 0; i < 10000; i++) {
+        char c = 'a' + (i % 26);
+
+        assert_true(strbuf_append(b, &c, 1) == 1);
+    }
+    assert_true(strbuf_len(b) == 10000);
+
+    assert_true(strbuf_delete(b, 9990) == 0);
+    assert_true(strbuf_shrink(b) == 0);
+
+    str = strbuf_strdup(b);
+    assert_true(strcmp(str, "ghijklmnop") == 0);
+    free(str);
+
+    strbuf_free(b);
+}
+
+static void test_strbuf_highwater(void **data)
+{
+    strbuf_t b = strbuf_new();
+    char big[4096] = {0};
+    char *line = NULL;
+    size_t linelen = 0;
+
+    strbuf_set_highwater(b, 128);
+
+    memset(big, 'x', sizeof(big) - 3);
+    memcpy(big + sizeof(big) - 3, "\r\n", 2);
+
+    strbuf_append(b, big, -1);
+    assert_true(strbuf_getstr(b, &line, &linelen, "\r\n") == 0);
+    assert_true(linelen == sizeof(big) - 1);
+    assert_true(strbuf_len(b) == 0);
+    free(line);
+
+    /* the buffer is still usable after it has been shrunk
+     */
+    strbuf_append(b, "foo\r\n", -1);
+    assert_true(strbuf_getstr(b, &line, &linelen, "\r\n") == 0);
+    assert_true(strcmp(line, "foo\r\n") == 0);
+    free(line);
+
+    strbuf_free(b);
+}
+
+static void test_strbuf_peekstrv(void **data)
+{
+    strbuf_t b = strbuf_new();
+    struct iovec iov[2];
+    char const *line = NULL;
+    size_t linelen = 0;
+
+    strbuf_append(b, "one\r\ntwo\r\nthree\r\nfour", -1);
+
+    assert_true(strbuf_peekstrv(b, iov, 2, "\r\n") == 2);
+    assert_true(iov[0].iov_len == strlen("one\r\n"));
+    assert_true(strncmp(iov[0].iov_base, "one\r\n", iov[0].iov_len) == 0);
+    assert_true(iov[1].iov_len == strlen("two\r\n"));
+    assert_true(strncmp(iov[1].iov_base, "two\r\n", iov[1].iov_len) == 0);
+    assert_true(strbuf_delete(b, iov[0].iov_len + iov[1].iov_len) == 0);
+
+    assert_true(strbuf_peekstrv(b, iov, 2, "\r\n") == 1);
+    assert_true(iov[0].iov_len == strlen("three\r\n"));
+
+    /* lines already handed out are still found after a failed scan
+     */
+    assert_true(strbuf_peekstr(b, &line, &linelen, "\r\n") == 0);
+    assert_true(linelen == strlen("three\r\n"));
+    assert_true(strbuf_delete(b, linelen) == 0);
+
+    assert_true(strbuf_peekstrv(b, iov, 2, "\r\n") == 0);
+
+    strbuf_free(b);
+}
+
 int main(int ac, char **av)
 {
     const struct CMUnitTest tests[] = {
@@ -230,6 +414,13 @@ int main(int ac, char **av)
         cmocka_unit_test(test_strbuf_getstr_empty),
         cmocka_unit_test(test_strbuf_getstr_depleted),
         cmocka_unit_test(test_strbuf_getstr_partial),
+        cmocka_unit_test(test_strbuf_getstr_interleaved),
+        cmocka_unit_test(test_strbuf_peekstr),
+        cmocka_unit_test(test_strbuf_getstr_split_delimiter),
+        cmocka_unit_test(test_strbuf_getstr_long_lines),
+        cmocka_unit_test(test_strbuf_append_bytewise),
+        cmocka_unit_test(test_strbuf_highwater),
+        cmocka_unit_test(test_strbuf_peekstrv),
     };
 
     return cmocka_run_group_tests(tests, NULL, NULL);
@@ -92,6 +92,45 @@ static void test_tag_escape(void **data)
     ASSERT_TAG_ESCAPED("; \\\r\n", "\\:\\s\\\\\\r\\n");
 }
 
+static void test_tag_unescape_into(void **data)
+{
+    char buf[64];
+    size_t len = 0;
+
+    /* in place
+     */
+    strcpy(buf, "plain value");
+    len = irc_tag_unescape_into(buf, buf, strlen(buf));
+    assert_int_equal(len, strlen("plain value"));
+    assert_memory_equal(buf, "plain value", len);
+
+    strcpy(buf, "a\\sb\\:c\\\\d\\r\\ne\\xf\\");
+    len = irc_tag_unescape_into(buf, buf, strlen(buf));
+    assert_int_equal(len, 12);
+    assert_memory_equal(buf, "a b;c\\d\r\nexf", len);
+}
+
+static void test_tag_string(void **data)
+{
+    irc_tag_t t = irc_tag_make("key", "a b;c");
+    char *str = NULL;
+    size_t len = 0;
+
+    assert_non_null(t);
+    assert_return_code(irc_tag_string(t, &str, &len), irc_error_success);
+    assert_string_equal(str, "key=a\\sb\\:c");
+    assert_int_equal(len, strlen(str));
+    free(str);
+    irc_tag_free(t);
+
+    t = irc_tag_make("flag", NULL);
+    assert_non_null(t);
+    assert_return_code(irc_tag_string(t, &str, &len), irc_error_success);
+    assert_string_equal(str, "flag");
+    free(str);
+    irc_tag_free(t);
+}
+
 int main(int ac, char **av)
 {
     const struct CMUnitTest tests[] = {
@@ -100,6 +139,8 @@ int main(int ac, char **av)
         cmocka_unit_test_setup_teardown(test_tag_parse_single, setup, teardown),
         cmocka_unit_test(test_tag_unescape),
         cmocka_unit_test(test_tag_escape),
+        cmocka_unit_test(test_tag_unescape_into),
+        cmocka_unit_test(test_tag_string),
     };
 
     return cmocka_run_group_tests(tests, NULL, NULL);
@@ -0,0 +1,116 @@
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <cmocka.h>
+#include <stdint.h>
+
+#include <irc/template.h>
+
+#define SLICE(s) { s, sizeof(s) - 1 }
+
+static int setup(void **data)
+{
+    irc_template_t t = irc_template_new("PRIVMSG %s :%s");
+    if (t == NULL) {
+        return -1;
+    }
+
+    *data = t;
+
+    return 0;
+}
+
+static int teardown(void **data)
+{
+    irc_template_free(*data);
+
+    return 0;
+}
+
+static void test_template_render(void **data)
+{
+    irc_template_t t = *data;
+    irc_slice_t args[] = { SLICE("#channel"), SLICE("hello there") };
+    char const *expected = "PRIVMSG #channel :hello there\r\n";
+    char buf[512];
+    ssize_t len = 0;
+
+    assert_int_equal(irc_template_slots(t), 2);
+
+    len = irc_template_render(t, buf, sizeof(buf), args, 2);
+    assert_int_equal(len, strlen(expected));
+    assert_memory_equal(buf, expected, len);
+
+    /* too small, only the size needed is returned
+     */
+    memset(buf, 'X', sizeof(buf));
+    assert_int_equal(irc_template_render(t, buf, 10, args, 2), len);
+    assert_int_equal(buf[0], 'X');
+
+    assert_int_equal(irc_template_render(t, buf, sizeof(buf), args, 1), -1);
+}
+
+static void test_template_invalid(void **data)
+{
+    irc_template_t t = *data;
+    irc_slice_t space[] = { SLICE("#a b"), SLICE("text") };
+    irc_slice_t colon[] = { SLICE(":x"), SLICE("text") };
+    irc_slice_t crlf[] = { SLICE("#a"), SLICE("text\r\nQUIT") };
+    irc_slice_t empty[] = { SLICE("#a"), SLICE("") };
+    char buf[512];
+
+    assert_int_equal(irc_template_render(t, buf, sizeof(buf), space, 2), -1);
+    assert_int_equal(irc_template_render(t, buf, sizeof(buf), colon, 2), -1);
+    assert_int_equal(irc_template_render(t, buf, sizeof(buf), crlf, 2), -1);
+    assert_int_equal(irc_template_render(t, buf, sizeof(buf), empty, 2),
+                     strlen("PRIVMSG #a :\r\n"));
+
+    /* only the last argument can be a final one
+     */
+    assert_null(irc_template_new("TOPIC :%s %s"));
+}
+
+static void test_template_message(void **data)
+{
+    irc_template_t t = *data;
+    irc_slice_t args[] = { SLICE("#channel"), SLICE("hello there") };
+    irc_template_t mode = irc_template_new(":bot MODE %s +o %s");
+    irc_message_t m = NULL;
+
+    m = irc_template_message(t, NULL, args, 2);
+    assert_non_null(m);
+    assert_int_equal(m->code, irc_command_privmsg);
+    assert_int_equal(m->argslen, 2);
+    assert_string_equal(m->args[0], "#channel");
+    assert_string_equal(m->args[1], "hello there");
+    irc_message_unref(m);
+
+    assert_non_null(mode);
+    args[1].ptr = "nick";
+    args[1].len = 4;
+    m = irc_template_message(mode, NULL, args, 2);
+    assert_non_null(m);
+    assert_string_equal(m->prefix, "bot");
+    assert_int_equal(m->argslen, 3);
+    assert_string_equal(m->args[1], "+o");
+    assert_string_equal(m->args[2], "nick");
+    irc_message_unref(m);
+    irc_template_free(mode);
+}
+
+int main(int ac, char **av)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_template_render, setup,
+                                        teardown),
+        cmocka_unit_test_setup_teardown(test_template_invalid, setup,
+                                        teardown),
+        cmocka_unit_test_setup_teardown(test_template_message, setup,
+                                        teardown),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}